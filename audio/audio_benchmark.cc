@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "audio/wave.h"
+#include "dvc/file.h"
+#include "dvc/opts.h"
+#include "dvc/program.h"
+#include "dvc/string.h"
+
+// Times wave graphs of increasing size as the audio callback would run
+// them, without an audio device, so that DSP changes can be measured on any
+// machine.
+
+double DVC_OPTION(seconds, -, 10, "audio rendered per case, in seconds");
+uint32_t DVC_OPTION(rate, -, 48000, "frames per second");
+size_t DVC_OPTION(callback_frames, -, 128, "frames per audio callback");
+std::string DVC_OPTION(json, -, "", "if set, also write results here");
+
+struct Result {
+  std::string name;
+  double ns_per_frame;
+  double realtime_factor;
+  // Slowest callback, as a fraction of the time it has to fill its buffer.
+  double worst_callback_load;
+};
+
+PAudioWave oscillator(Waveform waveform) {
+  switch (waveform) {
+    case Waveform::sine:
+      return round_wave();
+    case Waveform::square:
+      return square_wave();
+    case Waveform::triangle:
+      return triangle_wave();
+    case Waveform::saw:
+      return saw_wave();
+  }
+  DVC_FATAL("Bad waveform");
+}
+
+// A chain of depth AddWaves of oscillators, as smoke_audio used to build.
+PAudioWave chain(Waveform waveform, size_t depth) {
+  PAudioWave wave = silence();
+  for (size_t i = 0; i < depth; i++) {
+    const double frequency = 110 * (1 + i % 24 / 24.0);
+    wave = std::move(wave) + reshape(oscillator(waveform), 1.0 / depth,
+                                     frequency);
+  }
+  return wave;
+}
+
+Result measure(const std::string& name, AudioWave& wave) {
+  std::vector<float> buffer(callback_frames);
+  const size_t callbacks = seconds * rate / callback_frames;
+  std::chrono::steady_clock::duration total{}, worst{};
+  for (size_t callback = 0; callback < callbacks; callback++) {
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < callback_frames; i += max_block_frames)
+      wave.process(1.0 / rate, &buffer[i],
+                   std::min(max_block_frames, callback_frames - i));
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    total += elapsed;
+    worst = std::max(worst, elapsed);
+  }
+  const double total_sec = std::chrono::duration<double>(total).count();
+  const double frames = double(callbacks) * callback_frames;
+  Result result = {
+      name, total_sec * 1e9 / frames, frames / rate / total_sec,
+      std::chrono::duration<double>(worst).count() * rate / callback_frames};
+  DVC_LOG(name, ": ", result.ns_per_frame, " ns/frame, ",
+          result.realtime_factor, "x real time, worst callback ",
+          100 * result.worst_callback_load, "% of budget");
+  return result;
+}
+
+int main(int argc, char** argv) {
+  dvc::program program(argc, argv);
+
+  std::vector<Result> results;
+  for (Waveform waveform : {Waveform::sine, Waveform::saw}) {
+    const std::string waveform_name =
+        waveform == Waveform::sine ? "sine" : "saw";
+    for (size_t depth : {1, 4, 16, 64}) {
+      PAudioWave wave = chain(waveform, depth);
+      results.push_back(
+          measure(dvc::concat("chain/", waveform_name, "/", depth), *wave));
+    }
+    for (size_t voices : {1, 4, 16}) {
+      VoicePool pool;
+      for (size_t note = 0; note < voices; note++)
+        DVC_ASSERT(pool.note_on(note, waveform, 110 * (1 + note / 16.0),
+                                1.0f / voices));
+      results.push_back(
+          measure(dvc::concat("voices/", waveform_name, "/", voices), pool));
+    }
+  }
+
+  if (!json.empty()) {
+    std::ostringstream out;
+    out << "{\n  \"rate\": " << rate
+        << ",\n  \"callback_frames\": " << callback_frames
+        << ",\n  \"cases\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+      const Result& result = results[i];
+      out << (i ? "," : "") << "\n    {\"name\": \"" << result.name
+          << "\", \"ns_per_frame\": " << result.ns_per_frame
+          << ", \"realtime_factor\": " << result.realtime_factor
+          << ", \"worst_callback_load\": " << result.worst_callback_load
+          << "}";
+    }
+    out << "\n  ]\n}\n";
+    dvc::save_file(json, out.str());
+  }
+}
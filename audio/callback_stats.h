@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "dvc/string.h"
+
+// How audio callbacks fare against their deadline.  The audio thread
+// records each callback with relaxed atomic stores, which never block it,
+// and any other thread may take a snapshot at any time.  A snapshot's
+// counters are each exact but may be from slightly different callbacks.
+class CallbackStats {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Buckets of callback duration over budget, the time the device takes to
+  // play one buffer: [0, 10%), [10%, 20%), ..., [90%, 100%) and late.
+  static constexpr size_t num_buckets = 11;
+
+  struct Snapshot {
+    uint64_t callbacks = 0;
+    std::array<uint64_t, num_buckets> histogram = {};
+    // Callbacks that started over two budgets after the previous one, by
+    // when the device had played everything it was given.  SDL does not
+    // report underruns, so this is the closest the callback can tell.
+    uint64_t underruns = 0;
+    // Longest callback over its budget.
+    float worst_load = 0;
+
+    uint64_t late() const { return histogram[num_buckets - 1]; }
+
+    // Counts since an earlier snapshot, with this snapshot's worst_load.
+    Snapshot since(const Snapshot& earlier) const {
+      Snapshot delta = *this;
+      delta.callbacks -= earlier.callbacks;
+      for (size_t i = 0; i < num_buckets; i++)
+        delta.histogram[i] -= earlier.histogram[i];
+      delta.underruns -= earlier.underruns;
+      return delta;
+    }
+
+    std::string describe() const {
+      std::string buckets;
+      for (size_t i = 0; i < num_buckets; i++)
+        buckets += dvc::concat(i ? " " : "", histogram[i]);
+      return dvc::concat(callbacks, " callbacks, ", late(), " late, ",
+                         underruns, " underruns, worst ", 100 * worst_load,
+                         "% of budget, by tenth of budget [", buckets, "]");
+    }
+  };
+
+  // Called by the audio thread at the end of each callback.
+  void record(Clock::time_point start, Clock::time_point end,
+              Clock::duration budget) {
+    const float load = std::chrono::duration<float>(end - start) / budget;
+    const size_t bucket = std::min(size_t(load * 10), num_buckets - 1);
+    bump(histogram[bucket]);
+    if (load > worst_load.load(std::memory_order_relaxed))
+      worst_load.store(load, std::memory_order_relaxed);
+    if (previous_start != Clock::time_point() &&
+        start - previous_start > 2 * budget)
+      bump(underruns);
+    previous_start = start;
+    bump(callbacks);
+  }
+
+  Snapshot snapshot() const {
+    Snapshot result;
+    result.callbacks = callbacks.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < num_buckets; i++)
+      result.histogram[i] = histogram[i].load(std::memory_order_relaxed);
+    result.underruns = underruns.load(std::memory_order_relaxed);
+    result.worst_load = worst_load.load(std::memory_order_relaxed);
+    return result;
+  }
+
+ private:
+  // Only the audio thread writes, so a load and store suffice.
+  static void bump(std::atomic<uint64_t>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> callbacks = 0;
+  std::array<std::atomic<uint64_t>, num_buckets> histogram = {};
+  std::atomic<uint64_t> underruns = 0;
+  std::atomic<float> worst_load = 0;
+  // Only touched by the audio thread.
+  Clock::time_point previous_start;
+};
@@ -0,0 +1,46 @@
+#include "audio/callback_stats.h"
+
+#include <cmath>
+
+#include "dvc/program.h"
+
+int main() {
+  dvc::program program;
+
+  using Clock = CallbackStats::Clock;
+  using std::chrono::microseconds;
+  const Clock::duration budget = microseconds(10000);
+  const Clock::time_point t0 = Clock::now();
+
+  CallbackStats stats;
+  // 5% of budget, then 55%, each a budget after the last.
+  stats.record(t0, t0 + microseconds(500), budget);
+  stats.record(t0 + budget, t0 + budget + microseconds(5500), budget);
+  const CallbackStats::Snapshot first = stats.snapshot();
+  DVC_ASSERT_EQ(first.callbacks, 2);
+  DVC_ASSERT_EQ(first.histogram[0], 1);
+  DVC_ASSERT_EQ(first.histogram[5], 1);
+  DVC_ASSERT_EQ(first.late(), 0);
+  DVC_ASSERT_EQ(first.underruns, 0);
+
+  // 112% of budget is late.
+  stats.record(t0 + 2 * budget, t0 + 2 * budget + microseconds(11200),
+               budget);
+  // Starting three budgets after the previous one is an underrun.
+  stats.record(t0 + 5 * budget, t0 + 5 * budget + microseconds(1000), budget);
+  const CallbackStats::Snapshot second = stats.snapshot();
+  DVC_ASSERT_EQ(second.callbacks, 4);
+  DVC_ASSERT_EQ(second.late(), 1);
+  DVC_ASSERT_EQ(second.underruns, 1);
+  DVC_ASSERT(std::abs(second.worst_load - 1.12f) < 1e-5);
+
+  // since counts only what happened in between, with the latest worst load.
+  const CallbackStats::Snapshot delta = second.since(first);
+  DVC_ASSERT_EQ(delta.callbacks, 2);
+  DVC_ASSERT_EQ(delta.histogram[0], 0);
+  DVC_ASSERT_EQ(delta.histogram[1], 1);
+  DVC_ASSERT_EQ(delta.histogram[5], 0);
+  DVC_ASSERT_EQ(delta.late(), 1);
+  DVC_ASSERT_EQ(delta.underruns, 1);
+  DVC_ASSERT_EQ(delta.worst_load, second.worst_load);
+}
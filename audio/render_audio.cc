@@ -0,0 +1,47 @@
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "audio/wav.h"
+#include "audio/wave.h"
+#include "dvc/opts.h"
+#include "dvc/program.h"
+#include "dvc/string.h"
+
+// Renders a chord on a VoicePool to a WAV file without an audio device.
+
+std::filesystem::path DVC_OPTION(output, o, dvc::required, "output WAV file");
+std::string DVC_OPTION(notes, -, "261.626,329.628,391.995",
+                       "comma separated note frequencies in Hz");
+std::string DVC_OPTION(waveform, -, "sine", "sine, square, triangle or saw");
+double DVC_OPTION(seconds, -, 2, "length of the output in seconds");
+double DVC_OPTION(hold, -, 1.5, "seconds before the notes are released");
+uint32_t DVC_OPTION(rate, -, 48000, "frames per second");
+
+int main(int argc, char** argv) {
+  dvc::program program(argc, argv);
+
+  VoicePool pool;
+  std::vector<std::string> frequencies = dvc::split(",", notes);
+  for (size_t note = 0; note < frequencies.size(); note++)
+    DVC_ASSERT(pool.note_on(note, parse_waveform(waveform),
+                            std::stof(frequencies[note]),
+                            1.0f / frequencies.size()));
+
+  const auto start = std::chrono::steady_clock::now();
+  const size_t hold_frames = hold * rate;
+  std::vector<float> samples = render_offline(pool, rate, hold_frames);
+  for (size_t note = 0; note < frequencies.size(); note++)
+    DVC_ASSERT(pool.note_off(note));
+  std::vector<float> tail =
+      render_offline(pool, rate, std::max(seconds - hold, 0.0) * rate);
+  samples.insert(samples.end(), tail.begin(), tail.end());
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  wav::save(output, samples, rate, 1);
+  DVC_LOG("rendered ", double(samples.size()) / rate, "s in ",
+          elapsed.count(), "s (",
+          double(samples.size()) / rate / elapsed.count(),
+          "x real time) to ", output);
+}
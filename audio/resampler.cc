@@ -0,0 +1,134 @@
+#include "audio/resampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "dvc/log.h"
+
+namespace {
+
+// Zero crossings of the sinc on each side of an output frame, so the
+// kernel's length in input frames grows as its cutoff falls.
+constexpr double half_crossings = 16;
+// Kaiser window shape, for about 70 dB of stopband attenuation.
+constexpr double kaiser_beta = 7;
+// Of the lower Nyquist frequency, leaving room for the transition band.
+constexpr double passband = 0.9;
+
+// Taps are summed in groups of this many independent partial sums, which
+// the compiler can vectorize without reassociating one float sum.
+constexpr size_t lanes = 8;
+
+double sinc(double x) {
+  return x == 0 ? 1 : std::sin(M_PI * x) / (M_PI * x);
+}
+
+// The filter's cutoff, as a fraction of the input's Nyquist frequency.
+double cutoff(uint32_t from, uint32_t to) {
+  return std::min(1.0, double(to) / from) * passband;
+}
+
+size_t num_taps(uint32_t from, uint32_t to) {
+  const size_t n = std::ceil(2 * half_crossings / cutoff(from, to));
+  return (n + lanes - 1) / lanes * lanes;
+}
+
+// The Kaiser window at r, from -1 to 1 across it.
+double kaiser(double r) {
+  if (std::abs(r) >= 1) return 0;
+  return std::cyl_bessel_i(0.0, kaiser_beta * std::sqrt(1 - r * r)) /
+         std::cyl_bessel_i(0.0, kaiser_beta);
+}
+
+}  // namespace
+
+Resampler::Resampler(uint32_t from, uint32_t to, size_t max_frames)
+    : from(from),
+      to(to),
+      step(double(from) / to),
+      taps(::num_taps(from, to)),
+      max_frames(max_frames),
+      kernel((num_phases + 1) * taps),
+      input(taps + size_t(std::ceil(max_frames * step)) + 1) {
+  DVC_ASSERT(from > 0 && to > 0);
+  const double fc = cutoff(from, to);
+  const double half_width = taps / 2.0;
+  for (size_t phase = 0; phase <= num_phases; phase++) {
+    float* row = &kernel[phase * taps];
+    double sum = 0;
+    for (size_t k = 0; k < taps; k++) {
+      const double x = k - (taps / 2 - 1.0) - double(phase) / num_phases;
+      row[k] = fc * sinc(fc * x) * kaiser(x / half_width);
+      sum += row[k];
+    }
+    // Unity gain at DC for every phase, so that fractional offsets do not
+    // modulate a steady signal.
+    for (size_t k = 0; k < taps; k++) row[k] /= sum;
+  }
+  // The frames before the wave starts are silent.
+  num_input = taps / 2 - 1;
+}
+
+// render relies on this to keep phases in range.
+static_assert((Resampler::num_phases & (Resampler::num_phases - 1)) == 0);
+
+void Resampler::render(AudioWave& wave, float* out, size_t frames) {
+  DVC_ASSERT_LE(frames, max_frames);
+  if (frames == 0) return;
+
+  const size_t needed = size_t(position + (frames - 1) * step) + taps;
+  DVC_ASSERT_LE(needed, input.size());
+  while (num_input < needed) {
+    const size_t n = std::min(max_block_frames, needed - num_input);
+    wave.process(1.0 / from, &input[num_input], n);
+    num_input += n;
+  }
+
+  for (size_t i = 0; i < frames; i++, position += step) {
+    const size_t base = position;
+    // In double, where scaling a fraction below 1 by num_phases, a power of
+    // two, stays below num_phases.  In float it could round up to
+    // num_phases and read a row past the kernel.
+    const double offset = (position - base) * num_phases;
+    const size_t phase = offset;
+    const float t = offset - phase;
+    const float* row0 = &kernel[phase * taps];
+    const float* row1 = row0 + taps;
+    const float* x = &input[base];
+    float sums[lanes] = {};
+    for (size_t k = 0; k < taps; k += lanes)
+      for (size_t l = 0; l < lanes; l++)
+        sums[l] += (row0[k + l] + t * (row1[k + l] - row0[k + l])) * x[k + l];
+    float sum = 0;
+    for (size_t l = 0; l < lanes; l++) sum += sums[l];
+    out[i] = sum;
+  }
+
+  const size_t consumed = position;
+  std::copy(input.begin() + consumed, input.begin() + num_input,
+            input.begin());
+  num_input -= consumed;
+  position -= consumed;
+}
+
+void map_channels(const float* in, size_t frames, int channels, float* out) {
+  if (channels == 2) {
+    for (size_t i = 0; i < frames; i++) out[2 * i] = out[2 * i + 1] = in[i];
+    return;
+  }
+  const int mapped = std::min(channels, 2);
+  for (size_t i = 0; i < frames; i++) {
+    for (int c = 0; c < mapped; c++) out[i * channels + c] = in[i];
+    for (int c = mapped; c < channels; c++) out[i * channels + c] = 0;
+  }
+}
+
+void map_channels(const float* in, size_t frames, int channels,
+                  int16_t* out) {
+  const int mapped = std::min(channels, 2);
+  for (size_t i = 0; i < frames; i++) {
+    const int16_t sample = std::clamp(in[i], -1.0f, 1.0f) * 32767;
+    for (int c = 0; c < mapped; c++) out[i * channels + c] = sample;
+    for (int c = mapped; c < channels; c++) out[i * channels + c] = 0;
+  }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "audio/wave.h"
+
+// Renders a wave at one rate as a stream at another, for a wave graph
+// that runs at a rate the audio device does not.  Each output frame is a
+// windowed sinc interpolation of the taps input frames around it, with
+// the filter cut off below the lower of the two Nyquist frequencies.  The
+// kernel is tabulated at num_phases + 1 fractional offsets and linearly
+// interpolated between them.
+class Resampler {
+ public:
+  static constexpr size_t num_phases = 128;
+
+  // Output is produced up to max_frames frames per call.
+  Resampler(uint32_t from, uint32_t to, size_t max_frames);
+
+  // Writes the next frames output frames, for frames <= max_frames,
+  // rendering as many new frames of wave as they need.
+  void render(AudioWave& wave, float* out, size_t frames);
+
+  uint32_t input_rate() const { return from; }
+  uint32_t output_rate() const { return to; }
+  size_t num_taps() const { return taps; }
+
+ private:
+  const uint32_t from, to;
+  // Input frames per output frame.
+  const double step;
+  const size_t taps;
+  const size_t max_frames;
+  // kernel[phase * taps + k] weighs input frame k of the taps around an
+  // output frame phase / num_phases of the way past the first of them.
+  std::vector<float> kernel;
+  // Rendered input frames from the first that the next output frame needs.
+  std::vector<float> input;
+  size_t num_input = 0;
+  // Offset of the next output frame from input[taps / 2 - 1], in [0, 1).
+  double position = 0;
+};
+
+// Writes mono frames to a device's interleaved channels: both of stereo,
+// the one of mono, and the front left and right of a surround layout, its
+// other channels silent.
+void map_channels(const float* in, size_t frames, int channels, float* out);
+void map_channels(const float* in, size_t frames, int channels, int16_t* out);
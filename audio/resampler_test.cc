@@ -0,0 +1,53 @@
+#include <cmath>
+
+#include "audio/resampler.h"
+#include "dvc/program.h"
+
+// Resamples frames frames of wave in device-sized callbacks.
+std::vector<float> resample(AudioWave& wave, uint32_t from, uint32_t to,
+                            size_t frames) {
+  Resampler resampler(from, to, 128);
+  std::vector<float> out(frames);
+  for (size_t i = 0; i < frames; i += 128)
+    resampler.render(wave, &out[i], std::min<size_t>(128, frames - i));
+  return out;
+}
+
+int main() {
+  dvc::program program;
+
+  // A tone in the passband comes out as if rendered at the output rate,
+  // once the filter is past the silence before the wave started.
+  for (auto [from, to] : {std::pair<uint32_t, uint32_t>{44100, 48000},
+                          {48000, 44100},
+                          {32000, 48000},
+                          {96000, 48000},
+                          {48000, 48000}}) {
+    PAudioWave source = reshape(round_wave(), 0.5, 1000);
+    PAudioWave reference = reshape(round_wave(), 0.5, 1000);
+    const std::vector<float> resampled = resample(*source, from, to, 4800);
+    const std::vector<float> expected = render_offline(*reference, to, 4800);
+    for (size_t i = 100; i < resampled.size(); i++)
+      DVC_ASSERT_LT(std::abs(resampled[i] - expected[i]), 2e-3);
+  }
+
+  // A tone above the output's Nyquist frequency is filtered out rather
+  // than aliased, past the click of its start.
+  PAudioWave high = reshape(round_wave(), 0.5, 30000);
+  const std::vector<float> filtered = resample(*high, 96000, 48000, 4800);
+  for (size_t i = 100; i < filtered.size(); i++)
+    DVC_ASSERT_LT(std::abs(filtered[i]), 2e-4);
+
+  // Mono fills the front pair of a surround layout.
+  const float mono[2] = {0.5, -2};
+  int16_t surround[12];
+  map_channels(mono, 2, 6, surround);
+  for (int c = 0; c < 6; c++) {
+    DVC_ASSERT_EQ(surround[c], c < 2 ? 16383 : 0);
+    DVC_ASSERT_EQ(surround[6 + c], c < 2 ? -32767 : 0);
+  }
+  float stereo[4];
+  map_channels(mono, 2, 2, stereo);
+  DVC_ASSERT_EQ(stereo[1], 0.5f);
+  DVC_ASSERT_EQ(stereo[2], -2.0f);
+}
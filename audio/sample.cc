@@ -0,0 +1,140 @@
+#include "audio/sample.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "dvc/log.h"
+
+float decode_frame(const wav::View& wav, size_t i) {
+  const char* frame = wav.data.data() + i * wav.format.block_align;
+  float sum = 0;
+  for (uint16_t channel = 0; channel < wav.format.channels; channel++) {
+    if (wav.format.format_tag == wav::format_pcm) {
+      int16_t sample;
+      std::memcpy(&sample, frame + channel * sizeof(sample), sizeof(sample));
+      sum += sample * (1 / 32768.0f);
+    } else {
+      float sample;
+      std::memcpy(&sample, frame + channel * sizeof(sample), sizeof(sample));
+      sum += sample;
+    }
+  }
+  return sum / wav.format.channels;
+}
+
+Sample::Sample(std::string_view wav_file) {
+  const wav::View wav = wav::parse(wav_file);
+  frames.resize(wav.frames());
+  for (size_t i = 0; i < frames.size(); i++) frames[i] = decode_frame(wav, i);
+  rate = wav.format.rate;
+}
+
+const Sample& SampleBank::get(const std::string& name) {
+  std::unique_ptr<Sample>& sample = samples[name];
+  if (!sample) sample = std::make_unique<Sample>(reader.get_file(name));
+  return *sample;
+}
+
+void SamplePlayer::process(double dt, float* out, size_t frames) {
+  for (PlayEvent event; events.pop(event);) {
+    auto remaining = [](const Voice& voice) {
+      return voice.sample ? voice.sample->frames.size() - voice.position
+                          : -1.0;
+    };
+    Voice* chosen = &voices[0];
+    for (Voice& voice : voices)
+      if (remaining(voice) < remaining(*chosen)) chosen = &voice;
+    *chosen = {event.sample, 0, event.gain};
+  }
+
+  std::fill(out, out + frames, 0.0f);
+  for (Voice& voice : voices) {
+    if (!voice.sample) continue;
+    const std::vector<float>& data = voice.sample->frames;
+    const double step = voice.sample->rate * dt;
+    for (size_t i = 0; i < frames; i++, voice.position += step) {
+      const size_t index = voice.position;
+      if (index >= data.size()) {
+        voice.sample = nullptr;
+        break;
+      }
+      const float next = index + 1 < data.size() ? data[index + 1] : 0;
+      const float fraction = voice.position - index;
+      out[i] += voice.gain * (data[index] + fraction * (next - data[index]));
+    }
+  }
+}
+
+void FrameRing::write(const float* in, size_t n) {
+  const uint64_t start = written.load(std::memory_order_relaxed);
+  const size_t offset = start % frames.size();
+  const size_t first = std::min(n, frames.size() - offset);
+  std::copy(in, in + first, frames.begin() + offset);
+  std::copy(in + first, in + n, frames.begin());
+  written.store(start + n, std::memory_order_release);
+}
+
+size_t FrameRing::read(float* out, size_t n) {
+  const uint64_t start = read_count.load(std::memory_order_relaxed);
+  n = std::min<uint64_t>(n, written.load(std::memory_order_acquire) - start);
+  const size_t offset = start % frames.size();
+  const size_t first = std::min(n, frames.size() - offset);
+  std::copy(frames.begin() + offset, frames.begin() + offset + first, out);
+  std::copy(frames.begin(), frames.begin() + (n - first), out + first);
+  read_count.store(start + n, std::memory_order_release);
+  return n;
+}
+
+StreamWave::StreamWave(std::string_view wav_file, uint32_t rate, bool loop)
+    : wav(wav::parse(wav_file)),
+      step(double(wav.format.rate) / rate),
+      loop(loop),
+      // A quarter second ahead of the audio thread.
+      ring(rate / 4) {
+  if (wav.frames() == 0) DVC_FAIL("Empty WAV stream");
+  // Starts full, so that the first callbacks never wait for the decoder.
+  if (decode()) {
+    decoder = std::thread([this] {
+      while (!stopping.load() && decode())
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    });
+  }
+}
+
+StreamWave::~StreamWave() {
+  stopping = true;
+  if (decoder.joinable()) decoder.join();
+}
+
+bool StreamWave::decode() {
+  std::array<float, max_block_frames> chunk;
+  for (size_t space; (space = ring.space()) > 0;) {
+    const size_t wanted = std::min(space, chunk.size());
+    size_t n = 0;
+    for (; n < wanted; n++, position += step) {
+      if (position >= wav.frames()) {
+        if (!loop) break;
+        position -= wav.frames();
+      }
+      const size_t index = position;
+      const float frame = decode_frame(wav, index);
+      const float next = index + 1 < wav.frames() ? decode_frame(wav, index + 1)
+                         : loop                   ? decode_frame(wav, 0)
+                                                  : 0;
+      chunk[n] = frame + float(position - index) * (next - frame);
+    }
+    if (n < wanted) ended = true;
+    ring.write(chunk.data(), n);
+    if (ended) return false;
+  }
+  return true;
+}
+
+void StreamWave::process(double dt, float* out, size_t frames) {
+  const size_t n = ring.read(out, frames);
+  std::fill(out + n, out + frames, 0.0f);
+  if (n < frames && !finished())
+    starved.store(starved.load(std::memory_order_relaxed) + frames - n,
+                  std::memory_order_relaxed);
+}
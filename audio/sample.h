@@ -0,0 +1,137 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "audio/wav.h"
+#include "audio/wave.h"
+#include "resource/resource.h"
+
+// Recorded sound.  Short effects are decoded once into a Sample and played
+// by a SamplePlayer; long tracks are decoded while they play by a
+// StreamWave.  Both read WAV files in place, such as those a
+// ResourceReader maps, and mix channels down to the mono of the wave
+// graph.
+
+// Frame i of wav, its channels averaged, for i < wav.frames().
+float decode_frame(const wav::View& wav, size_t i);
+
+// A decoded effect.
+struct Sample {
+  explicit Sample(std::string_view wav_file);
+
+  std::vector<float> frames;
+  uint32_t rate;
+};
+
+// The Samples of a resource file, each decoded when first asked for.
+class SampleBank {
+ public:
+  explicit SampleBank(ResourceReader& reader) : reader(reader) {}
+
+  // Valid for the bank's lifetime.
+  const Sample& get(const std::string& name);
+
+ private:
+  ResourceReader& reader;
+  std::map<std::string, std::unique_ptr<Sample>> samples;
+};
+
+// Plays any number of Samples at once, up to max_voices, started by play
+// from one other thread.  Like VoicePool it neither allocates nor locks
+// once built.  Samples are resampled to the graph's rate by linear
+// interpolation.
+class SamplePlayer : public AudioWave {
+ public:
+  static constexpr size_t max_voices = 32;
+
+  // Starts sample, which must outlive the player, replacing the voice
+  // nearest its end if all are playing.  False if the event queue is full.
+  bool play(const Sample& sample, float gain) {
+    return events.push({&sample, gain});
+  }
+
+  void process(double dt, float* out, size_t frames) override;
+
+ private:
+  struct PlayEvent {
+    const Sample* sample;
+    float gain;
+  };
+
+  struct Voice {
+    const Sample* sample = nullptr;
+    // In frames of sample.
+    double position = 0;
+    float gain = 0;
+  };
+
+  std::array<Voice, max_voices> voices;
+  SpscQueue<PlayEvent, 64> events;
+};
+
+// Frames passed from one producer thread to one consumer thread in bulk,
+// without blocking or allocating once built.
+class FrameRing {
+ public:
+  explicit FrameRing(size_t capacity) : frames(capacity) {}
+
+  // Called by the producer: frames that write can take.
+  size_t space() const {
+    return frames.size() - (written.load(std::memory_order_relaxed) -
+                            read_count.load(std::memory_order_acquire));
+  }
+
+  // Called by the producer, with n <= space().
+  void write(const float* in, size_t n);
+
+  // Called by the consumer.  Reads up to n frames and returns how many.
+  size_t read(float* out, size_t n);
+
+ private:
+  std::vector<float> frames;
+  // Frames ever written and read, on separate cache lines.
+  alignas(64) std::atomic<uint64_t> written = 0;
+  alignas(64) std::atomic<uint64_t> read_count = 0;
+};
+
+// Plays a WAV file, which must outlive the wave, decoding and resampling it
+// to rate frames per second on a background thread ahead of the audio
+// thread.  The wave plays at rate whatever dt it is given.
+class StreamWave : public AudioWave {
+ public:
+  StreamWave(std::string_view wav_file, uint32_t rate, bool loop);
+  ~StreamWave();
+
+  void process(double dt, float* out, size_t frames) override;
+
+  // Frames the audio thread wanted before the decoder had them.
+  uint64_t starved_frames() const {
+    return starved.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // Decodes into the ring until it is full or the file ends.  False at the
+  // end of a file that does not loop.
+  bool decode();
+
+  bool finished() const { return ended.load(std::memory_order_relaxed); }
+
+  const wav::View wav;
+  const double step;
+  const bool loop;
+  // In frames of wav, only touched by the decoder.
+  double position = 0;
+  FrameRing ring;
+  std::atomic<uint64_t> starved = 0;
+  // Set once the decoder has reached the end of a file that does not loop.
+  std::atomic<bool> ended = false;
+  std::atomic<bool> stopping = false;
+  std::thread decoder;
+};
@@ -0,0 +1,49 @@
+#include <cmath>
+
+#include "audio/sample.h"
+#include "dvc/program.h"
+
+int main() {
+  dvc::program program;
+
+  // A stereo ramp whose channels average to i / 2000.
+  std::vector<float> ramp;
+  for (int i = 0; i < 1000; i++) {
+    ramp.push_back(i / 2000.0f + 0.25f);
+    ramp.push_back(i / 2000.0f - 0.25f);
+  }
+  const std::string file = wav::encode(ramp, 24000, 2);
+  const wav::View view = wav::parse(file);
+  DVC_ASSERT_EQ(view.format.rate, 24000);
+  DVC_ASSERT_EQ(view.frames(), 1000);
+  const Sample sample(file);
+  for (size_t i = 0; i < sample.frames.size(); i++)
+    DVC_ASSERT_LT(std::abs(sample.frames[i] - i / 2000.0f), 1e-4);
+
+  // Played at twice its rate, each frame is interpolated halfway.
+  SamplePlayer player;
+  DVC_ASSERT(player.play(sample, 1));
+  DVC_ASSERT(player.play(sample, -1));
+  DVC_ASSERT(player.play(sample, 0.5));
+  std::vector<float> played = render_offline(player, 48000, 2100);
+  for (size_t i = 0; i < 1998; i++)
+    DVC_ASSERT_LT(std::abs(played[i] - 0.5f * i / 4000), 1e-4);
+  DVC_ASSERT_EQ(played.back(), 0.0f);
+
+  // A stream shorter than its ring is decoded before it starts.
+  std::vector<float> tone(4800);
+  for (size_t i = 0; i < tone.size(); i++)
+    tone[i] = 0.5 * std::sin(2 * M_PI * i / 48);
+  const std::string tone_file = wav::encode(tone, 48000, 1);
+  StreamWave once(tone_file, 48000, false);
+  std::vector<float> streamed = render_offline(once, 48000, 6000);
+  for (size_t i = 0; i < tone.size(); i++)
+    DVC_ASSERT_LT(std::abs(streamed[i] - tone[i]), 1e-4);
+  DVC_ASSERT_EQ(streamed.back(), 0.0f);
+  DVC_ASSERT_EQ(once.starved_frames(), 0);
+
+  StreamWave looped(tone_file, 48000, true);
+  streamed = render_offline(looped, 48000, 9600);
+  for (size_t i = 0; i < streamed.size(); i++)
+    DVC_ASSERT_LT(std::abs(streamed[i] - tone[i % tone.size()]), 1e-4);
+}
@@ -1,190 +1,238 @@
 #include <SDL2/SDL.h>
 #include <sys/types.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
 #include <functional>
 #include <map>
 #include <mutex>
 #include <thread>
+#include <vector>
 
+#include "audio/callback_stats.h"
+#include "audio/resampler.h"
+#include "audio/sample.h"
+#include "audio/wave.h"
 #include "dvc/log.h"
+#include "dvc/opts.h"
+#include "dvc/string.h"
+#include "resource/resource.h"
 #include "spk/program.h"
 
-class AudioWave {
- public:
-  virtual double sample(double t, size_t channel) = 0;
-};
-using PAudioWave = std::unique_ptr<AudioWave>;
-
-class RoundWave : public AudioWave {
- public:
-  double sample(double t, size_t channel) override {
-    return std::sin(t * 2 * M_PI);
-  }
-};
-
-PAudioWave round_wave() { return std::make_unique<RoundWave>(); }
-
-class SquareWave : public AudioWave {
- public:
-  double sample(double t, size_t channel) override {
-    return std::fmod(t, 1.0) < 0.5 ? 1.0 : -1.0;
-  };
-};
-
-PAudioWave square_wave() { return std::make_unique<SquareWave>(); }
-
-class TriangleWave : public AudioWave {
-  double sample(double t, size_t channel) override {
-    double d = std::fmod(t, 1.0);
-    if (d < 0.25)
-      return 4 * d;
-    else if (d < 0.75)
-      return 2 + (-4 * d);
-    else
-      return 4 * d - 2;
-  }
-};
-
-PAudioWave triangle_wave() { return std::make_unique<TriangleWave>(); }
-
-class SawWave : public AudioWave {
-  double sample(double t, size_t channel) override {
-    double d = std::fmod(t, 1.0);
-    return 2 * d - 1;
-  };
-};
-
-PAudioWave saw_wave() { return std::make_unique<SawWave>(); }
-
-class ReshapeWave : public AudioWave {
- public:
-  ReshapeWave(PAudioWave subwave, double amplitude, double frequency)
-      : subwave(std::move(subwave)),
-        amplitude(amplitude),
-        frequency(frequency) {}
-
-  double sample(double t, size_t channel) override {
-    return amplitude * subwave->sample(t * frequency, channel);
-  }
-
- private:
-  PAudioWave subwave;
-  double amplitude;
-  double frequency;
-};
-
-PAudioWave reshape(PAudioWave subwave, double amplitude, double frequency) {
-  return std::make_unique<ReshapeWave>(std::move(subwave), amplitude,
-                                       frequency);
-}
-
-class SilentWave : public AudioWave {
- public:
-  double sample(double t, size_t channel) override { return 0; }
-};
-
-PAudioWave silence() { return std::make_unique<SilentWave>(); }
-
-class AddWave : public AudioWave {
- public:
-  AddWave(PAudioWave a, PAudioWave b) : a(std::move(a)), b(std::move(b)) {}
-
-  double sample(double t, size_t channel) override {
-    return a->sample(t, channel) + b->sample(t, channel);
-  }
-
- private:
-  PAudioWave a, b;
-};
-
-PAudioWave operator+(PAudioWave a, PAudioWave b) {
-  return std::make_unique<AddWave>(std::move(a), std::move(b));
-}
+double DVC_OPTION(audio_stats_period, -, 0,
+                  "seconds between audio callback timing reports, 0 for none");
+std::string DVC_OPTION(sounds, -, "",
+                       "resource file of WAV files for --effects and --music");
+std::string DVC_OPTION(effects, -, "",
+                       "comma separated WAV files in --sounds for keys 1 to 4");
+std::string DVC_OPTION(music, -, "", "WAV file in --sounds to stream on a loop");
+uint32_t DVC_OPTION(graph_rate, -, 48000,
+                    "frames per second the wave graph runs at, resampled to "
+                    "the device's if they differ");
+uint32_t DVC_OPTION(audio_rate, -, 48000, "device frames per second");
+uint32_t DVC_OPTION(audio_channels, -, 2, "device channels");
+std::string DVC_OPTION(audio_format, -, "f32", "device samples, f32 or s16");
+uint32_t DVC_OPTION(audio_samples, -, 128,
+                    "device buffer in frames: smaller for lower latency, "
+                    "larger for fewer callbacks on a slow machine");
+bool DVC_OPTION(audio_allow_changes, -, true,
+                "take the device's own rate, channels and buffer size if "
+                "they differ from those asked for, rather than have SDL "
+                "convert to them");
 
 class AudioSystem {
  public:
   AudioSystem() {
-    SDL_AudioSpec desired, obtained;
+    if (audio_format != "f32" && audio_format != "s16")
+      DVC_FAIL("Unknown --audio_format: ", audio_format);
+    if (audio_channels < 1 || audio_channels > 8)
+      DVC_FAIL("--audio_channels must be 1 to 8, not ", audio_channels);
+
+    SDL_AudioSpec desired;
     SDL_memset(&desired, 0, sizeof(desired));
-    desired.format = AUDIO_F32;
-    desired.freq = 48000;
-    desired.channels = 2;
-    desired.samples = 128;
+    desired.format = audio_format == "f32" ? AUDIO_F32 : AUDIO_S16;
+    desired.freq = audio_rate;
+    desired.channels = audio_channels;
+    desired.samples = audio_samples;
     desired.callback = generate_audio;
     desired.userdata = this;
 
+    // The format is always the one asked for, converted by SDL if need be,
+    // as the callback writes only these two.
+    const int allowed_changes =
+        audio_allow_changes ? SDL_AUDIO_ALLOW_FREQUENCY_CHANGE |
+                                  SDL_AUDIO_ALLOW_CHANNELS_CHANGE |
+                                  SDL_AUDIO_ALLOW_SAMPLES_CHANGE
+                            : 0;
     device_id = SDL_OpenAudioDevice(nullptr /*device*/, false /*iscapture*/,
-                                    &desired, &obtained, 0 /*allow changes*/);
+                                    &desired, &spec, allowed_changes);
+    if (device_id == 0) DVC_FAIL("Can't open audio device: ", SDL_GetError());
+    DVC_ASSERT_EQ(spec.format, desired.format);
+
+    if (uint32_t(spec.freq) != graph_rate)
+      resampler = std::make_unique<Resampler>(graph_rate, spec.freq,
+                                              max_block_frames);
+    DVC_LOG("audio device: ", spec.freq, " Hz, ", int(spec.channels),
+            " channels, ", audio_format, ", ", spec.samples,
+            " frame buffer; wave graph at ", graph_rate, " Hz",
+            resampler ? dvc::concat(", resampled with ",
+                                    resampler->num_taps(), " taps")
+                      : "");
+
     SDL_PauseAudioDevice(device_id, 0 /*pause_on*/);
-    DVC_ASSERT(device_id != 0);
   }
 
+  // Publishes wave to the audio thread without blocking it.  The replaced
+  // wave is retired rather than freed, since a callback may still be
+  // sampling it.
   void set_wave(PAudioWave wave) {
-    std::lock_guard lock(mu);
-    this->wave = std::move(wave);
+    PAudioWave old(this->wave.exchange(wave.release()));
+    retired.push_back({std::move(old), callbacks_finished.load()});
+    reclaim();
   }
-  ~AudioSystem() { SDL_CloseAudioDevice(device_id); }
 
- private:
-  static void generate_audio(void* userdata, Uint8* char_stream, int len) {
-    ((AudioSystem*)userdata)->generate_audio(char_stream, len);
+  ~AudioSystem() {
+    SDL_CloseAudioDevice(device_id);
+    delete wave.load();
   }
 
-  void generate_audio(Uint8* char_stream, int len) {
-    float* float_stream = (float*)char_stream;
+  // Timing of the audio callback, readable from any thread.
+  const CallbackStats& callback_stats() const { return stats; }
 
-    static size_t current_sample = 0;
-    DVC_ASSERT(len % (4 * 2) == 0);
-    size_t num_samples = len / (4 * 2);
+ private:
+  struct RetiredWave {
+    PAudioWave wave;
+    // callbacks_finished when the wave was replaced.
+    uint64_t callbacks_finished;
+  };
 
-    for (size_t i = 0; i < num_samples; i++, current_sample++) {
-      for (size_t channel = 0; channel < 2; channel++) {
-        float_stream[i * 2 + channel] =
-            generate_sample(double(current_sample) / 48000, channel);
-      }
-    }
+  // Frees the retired waves that no callback can still hold.  A callback
+  // holds the wave it loaded at its start, so once callbacks_finished has
+  // moved past its value at retirement, the callback that might have loaded
+  // the wave has returned and every later one sees its replacement.
+  void reclaim() {
+    const uint64_t finished = callbacks_finished.load();
+    retired.erase(std::remove_if(retired.begin(), retired.end(),
+                                 [&](const RetiredWave& r) {
+                                   return r.callbacks_finished < finished;
+                                 }),
+                  retired.end());
   }
 
-  double generate_sample(double t, size_t channel) {
-    std::lock_guard lock(mu);
-    if (wave)
-      return wave->sample(t, channel);
-    else
-      return 0;
+  static void generate_audio(void* userdata, Uint8* char_stream, int len) {
+    ((AudioSystem*)userdata)->generate_audio(char_stream, len);
   }
 
-  std::mutex mu;
-  PAudioWave wave;
+  void generate_audio(Uint8* char_stream, int len) {
+    const CallbackStats::Clock::time_point start = CallbackStats::Clock::now();
+    const size_t frame_bytes =
+        SDL_AUDIO_BITSIZE(spec.format) / 8 * spec.channels;
+    DVC_ASSERT(len % frame_bytes == 0);
+    const size_t num_frames = len / frame_bytes;
+
+    // The audio thread must not block, so it never locks or frees: it
+    // renders whichever wave is current for the whole buffer, a block at a
+    // time at the graph's rate, and maps each block to the device's rate,
+    // channels and format.
+    AudioWave* current = wave.load();
+    for (size_t i = 0; i < num_frames; i += max_block_frames) {
+      const size_t frames = std::min(max_block_frames, num_frames - i);
+      if (!current)
+        std::fill(block.begin(), block.begin() + frames, 0.0f);
+      else if (resampler)
+        resampler->render(*current, block.data(), frames);
+      else
+        current->process(1.0 / graph_rate, block.data(), frames);
+      if (spec.format == AUDIO_F32)
+        map_channels(block.data(), frames, spec.channels,
+                     (float*)char_stream + i * spec.channels);
+      else
+        map_channels(block.data(), frames, spec.channels,
+                     (int16_t*)char_stream + i * spec.channels);
+    }
+    stats.record(start, CallbackStats::Clock::now(),
+                 std::chrono::duration_cast<CallbackStats::Clock::duration>(
+                     std::chrono::duration<double>(double(num_frames) /
+                                                   spec.freq)));
+    callbacks_finished++;
+  }
 
+  std::array<float, max_block_frames> block;
+  std::atomic<AudioWave*> wave = nullptr;
+  std::atomic<uint64_t> callbacks_finished = 0;
+  CallbackStats stats;
+  // Replaced waves awaiting reclaim(), only touched by set_wave's thread.
+  std::vector<RetiredWave> retired;
+
+  // As obtained, which the callback writes.
+  SDL_AudioSpec spec;
+  // Only when the device's rate is not the graph's.
+  std::unique_ptr<Resampler> resampler;
   SDL_AudioDeviceID device_id;
 };
 
 class smoke_audio : public spkx::program {
  public:
-  using spkx::program::program;
+  smoke_audio(int argc, char** argv) : spkx::program(argc, argv) {
+    auto pool = std::make_unique<VoicePool>();
+    voices = pool.get();
+    PAudioWave wave = std::move(pool);
+    if (!sounds.empty()) {
+      sound_reader = std::make_unique<ResourceReader>(sounds);
+      sample_bank = std::make_unique<SampleBank>(*sound_reader);
+      if (!effects.empty())
+        for (const std::string& name : dvc::split(",", effects))
+          effect_samples.push_back(&sample_bank->get(name));
+      auto player = std::make_unique<SamplePlayer>();
+      samples = player.get();
+      wave = std::move(wave) + std::move(player);
+      if (!music.empty())
+        wave = std::move(wave) +
+               std::make_unique<StreamWave>(sound_reader->get_file(music),
+                                            graph_rate, true);
+    }
+    sys.set_wave(std::move(wave));
+    if (audio_stats_period > 0) reporter = std::thread([&] { report_stats(); });
+  }
+
+  ~smoke_audio() {
+    if (reporter.joinable()) {
+      {
+        std::lock_guard lock(reporter_mu);
+        stopping = true;
+      }
+      reporter_cv.notify_one();
+      reporter.join();
+    }
+  }
+
+  // Declared before sys, whose waves play from them.
+  std::unique_ptr<ResourceReader> sound_reader;
+  std::unique_ptr<SampleBank> sample_bank;
+  std::vector<const Sample*> effect_samples;
 
   AudioSystem sys;
+  // Owned by sys.
+  VoicePool* voices;
+  SamplePlayer* samples = nullptr;
 
   std::array<bool, 4> playing;
   std::array<double, 4> freqs = {261.626, 293.665, 329.628, 349.228};
 
-  void set_wave() {
-    PAudioWave w = silence();
-    for (int i = 0; i < 4; i++)
-      if (playing[i]) w = std::move(w) + reshape(round_wave(), 0.25, freqs[i]);
-    sys.set_wave(std::move(w));
-  }
-
   void start_playing(int note) {
     DVC_LOG("start_playing ", note);
 
-    set_wave();
+    if (!voices->note_on(note, Waveform::sine, freqs[note], 0.25))
+      DVC_ERROR("Dropped note on ", note);
   }
 
   void stop_playing(int note) {
     DVC_LOG("stop playing ", note);
 
-    set_wave();
+    if (!voices->note_off(note)) DVC_ERROR("Dropped note off ", note);
   }
 
   void key_change(const keyboard_event& event, bool down) {
@@ -206,12 +254,24 @@ class smoke_audio : public spkx::program {
     }
   }
 
+  void play_effect(const keyboard_event& event) {
+    static std::map<SDL_Keycode, size_t> keycode_to_effect = {
+        {SDLK_1, 0}, {SDLK_2, 1}, {SDLK_3, 2}, {SDLK_4, 3}};
+
+    auto it = keycode_to_effect.find(event.keysym.sym);
+    if (it != keycode_to_effect.end() && it->second < effect_samples.size()) {
+      if (!samples->play(*effect_samples[it->second], 0.5))
+        DVC_ERROR("Dropped effect ", it->second);
+    }
+  }
+
   void key_down(const keyboard_event& event) override {
     if (event.keysym.sym == SDLK_q) {
       shutdown();
       return;
     }
     key_change(event, true);
+    play_effect(event);
   }
 
   void key_up(const keyboard_event& event) override {
@@ -219,6 +279,23 @@ class smoke_audio : public spkx::program {
   }
 
  private:
+  // Logs the callbacks of each period, and of the whole run at the end.
+  void report_stats() {
+    const auto period = std::chrono::duration<double>(audio_stats_period);
+    CallbackStats::Snapshot last;
+    std::unique_lock lock(reporter_mu);
+    while (!reporter_cv.wait_for(lock, period, [&] { return stopping; })) {
+      CallbackStats::Snapshot now = sys.callback_stats().snapshot();
+      DVC_LOG("audio: ", now.since(last).describe());
+      last = now;
+    }
+    DVC_LOG("audio total: ", sys.callback_stats().snapshot().describe());
+  }
+
+  std::thread reporter;
+  std::mutex reporter_mu;
+  std::condition_variable reporter_cv;
+  bool stopping = false;
 };
 
 int main(int argc, char** argv) {
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "dvc/file.h"
+#include "dvc/log.h"
+
+// RIFF WAVE files of 16-bit PCM or 32-bit float samples.
+//
+// FILE:
+//     'RIFF' uint32(file_size - 8) 'WAVE' CHUNK*
+// CHUNK:
+//     'fmt ' uint32(size) Format
+//     'data' uint32(size) sample*
+// or any other chunk, which is skipped.  Chunks are padded to an even
+// size, and the samples of each frame are together, channel by channel.
+
+namespace wav {
+
+constexpr uint16_t format_pcm = 1;
+constexpr uint16_t format_ieee_float = 3;
+
+struct Format {
+  uint16_t format_tag;
+  uint16_t channels;
+  uint32_t rate;
+  uint32_t byte_rate;
+  uint16_t block_align;
+  uint16_t bits_per_sample;
+};
+static_assert(sizeof(Format) == 16);
+
+// A WAV file of interleaved samples in [-1, 1], clamping any outside it,
+// as 16-bit PCM.
+inline std::string encode(const std::vector<float>& samples, uint32_t rate,
+                          uint16_t channels) {
+  const Format format = {format_pcm,
+                         channels,
+                         rate,
+                         rate * channels * 2,
+                         uint16_t(channels * 2),
+                         16};
+  const uint32_t data_size = samples.size() * 2;
+
+  std::string file;
+  auto append = [&](const auto& value) {
+    file.append((const char*)&value, sizeof(value));
+  };
+  file += "RIFF";
+  append(uint32_t(4 + 8 + sizeof(Format) + 8 + data_size));
+  file += "WAVEfmt ";
+  append(uint32_t(sizeof(Format)));
+  append(format);
+  file += "data";
+  append(data_size);
+  for (float sample : samples)
+    append(int16_t(std::lround(std::clamp(sample, -1.0f, 1.0f) * 32767)));
+  return file;
+}
+
+inline void save(const std::filesystem::path& path,
+                 const std::vector<float>& samples, uint32_t rate,
+                 uint16_t channels) {
+  dvc::save_file(path, encode(samples, rate, channels));
+}
+
+// The format and samples of a WAV file, viewing the file's own bytes.
+struct View {
+  Format format;
+  std::string_view data;
+
+  size_t frames() const { return data.size() / format.block_align; }
+};
+
+// Parses file, which must be 16-bit PCM or 32-bit float.
+inline View parse(std::string_view file) {
+  if (file.size() < 12 || file.substr(0, 4) != "RIFF" ||
+      file.substr(8, 4) != "WAVE")
+    DVC_FAIL("Not a WAV file");
+  std::optional<Format> format;
+  for (size_t pos = 12; pos + 8 <= file.size();) {
+    const std::string_view id = file.substr(pos, 4);
+    uint32_t size;
+    std::memcpy(&size, file.data() + pos + 4, sizeof(size));
+    pos += 8;
+    if (size > file.size() - pos) DVC_FAIL("Truncated WAV chunk ", id);
+    if (id == "fmt ") {
+      if (size < sizeof(Format)) DVC_FAIL("Short WAV format chunk");
+      format.emplace();
+      std::memcpy(&*format, file.data() + pos, sizeof(Format));
+      const bool pcm16 = format->format_tag == format_pcm &&
+                         format->bits_per_sample == 16;
+      const bool float32 = format->format_tag == format_ieee_float &&
+                           format->bits_per_sample == 32;
+      if ((!pcm16 && !float32) || format->channels == 0 ||
+          format->block_align != format->channels * format->bits_per_sample / 8)
+        DVC_FAIL("Unsupported WAV format ", format->format_tag, " with ",
+                 format->bits_per_sample, " bits");
+    } else if (id == "data") {
+      if (!format) DVC_FAIL("WAV data before format");
+      return {*format, file.substr(pos, size)};
+    }
+    pos += size + size % 2;
+  }
+  DVC_FAIL("WAV file without data");
+}
+
+}  // namespace wav
@@ -0,0 +1,268 @@
+#include "audio/wave.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "dvc/log.h"
+
+// Writes a periodic wave of period 1 from phase start, advancing by step
+// each frame.  Each frame's phase is computed from start independently so
+// that the loop vectorizes.
+template <typename Shape>
+void render_shape(float start, float step, float* out, size_t frames) {
+  // Keeps the band limiting corrections finite for a stopped oscillator.
+  step = std::max(step, std::numeric_limits<float>::min());
+  for (size_t i = 0; i < frames; i++) {
+    float phase = start + int(i) * step;
+    phase -= int(phase);
+    out[i] = Shape()(phase, step);
+  }
+}
+
+// A periodic wave of period 1, rendered from a phase that it accumulates
+// in [0, 1) from block to block, so that its precision does not depend on
+// how long it has played.
+template <typename Shape>
+class Oscillator : public AudioWave {
+ public:
+  void process(double dt, float* out, size_t frames) override {
+    render_shape<Shape>(phase, dt, out, frames);
+    phase += frames * dt;
+    phase -= std::floor(phase);
+  }
+
+ private:
+  double phase = 0;
+};
+
+// The shapes are written without branches so that render_shape's loop
+// vectorizes.  Each takes its phase and the phase step per frame.
+
+// PolyBLEP: the difference between a unit step at phase 0 and the same
+// step band limited by a two-frame polynomial kernel.
+inline float poly_blep(float phase, float step) {
+  // Frames from the step, which is at both phase 0 and phase 1.
+  const float x = (phase - int(phase + 0.5f)) / step;
+  const float near = std::max(1 - std::abs(x), 0.0f);
+  return std::copysign(near * near / 2, -x);
+}
+
+// PolyBLAMP: the same for a unit change of slope per frame at phase 0,
+// which is the integral of poly_blep.
+inline float poly_blamp(float phase, float step) {
+  const float x = (phase - int(phase + 0.5f)) / step;
+  const float near = std::max(1 - std::abs(x), 0.0f);
+  return near * near * near / 6;
+}
+
+// sin(2 pi phase) from an odd polynomial on a quarter period.
+struct SineShape {
+  float operator()(float phase, float) const {
+    // sin(2 pi phase) = -sin(pi x), folded from [-1, 1) into [-1/2, 1/2].
+    float x = 2 * phase - 1;
+    x = std::max(std::min(x, 1 - x), -1 - x);
+    const float y = float(M_PI) * x, y2 = y * y;
+    return -y * (1 + y2 * (-1 / 6.0f +
+                           y2 * (1 / 120.0f +
+                                 y2 * (-1 / 5040.0f + y2 * (1 / 362880.0f)))));
+  }
+};
+
+// Steps up by 2 at phase 0 and down by 2 at phase 1/2.
+struct SquareShape {
+  float operator()(float phase, float step) const {
+    float opposite = phase + 0.5f;
+    opposite -= int(opposite);
+    return (phase < 0.5f ? 1.0f : -1.0f) + 2 * poly_blep(phase, step) -
+           2 * poly_blep(opposite, step);
+  }
+};
+
+// Slope 4 with corners at phase 1/4 and 3/4, where the slope per frame
+// changes by 8 * step.
+struct TriangleShape {
+  float operator()(float phase, float step) const {
+    float peak = phase + 0.75f, trough = phase + 0.25f;
+    peak -= int(peak);
+    trough -= int(trough);
+    return 1 - 4 * std::abs(trough - 0.5f) -
+           8 * step * (poly_blamp(peak, step) - poly_blamp(trough, step));
+  }
+};
+
+// Rises with slope 2 and steps down by 2 at phase 0.
+struct SawShape {
+  float operator()(float phase, float step) const {
+    return 2 * phase - 1 - 2 * poly_blep(phase, step);
+  }
+};
+
+Waveform parse_waveform(const std::string& name) {
+  if (name == "sine") return Waveform::sine;
+  if (name == "square") return Waveform::square;
+  if (name == "triangle") return Waveform::triangle;
+  if (name == "saw") return Waveform::saw;
+  DVC_FAIL("Unknown waveform: ", name);
+}
+
+void render_waveform(Waveform waveform, float start, float step, float* out,
+                     size_t frames) {
+  switch (waveform) {
+    case Waveform::sine:
+      return render_shape<SineShape>(start, step, out, frames);
+    case Waveform::square:
+      return render_shape<SquareShape>(start, step, out, frames);
+    case Waveform::triangle:
+      return render_shape<TriangleShape>(start, step, out, frames);
+    case Waveform::saw:
+      return render_shape<SawShape>(start, step, out, frames);
+  }
+}
+
+PAudioWave round_wave() { return std::make_unique<Oscillator<SineShape>>(); }
+
+PAudioWave square_wave() {
+  return std::make_unique<Oscillator<SquareShape>>();
+}
+
+PAudioWave triangle_wave() {
+  return std::make_unique<Oscillator<TriangleShape>>();
+}
+
+PAudioWave saw_wave() { return std::make_unique<Oscillator<SawShape>>(); }
+
+class ReshapeWave : public AudioWave {
+ public:
+  ReshapeWave(PAudioWave subwave, double amplitude, double frequency)
+      : subwave(std::move(subwave)),
+        amplitude(amplitude),
+        frequency(frequency) {}
+
+  void process(double dt, float* out, size_t frames) override {
+    subwave->process(dt * frequency, out, frames);
+    for (size_t i = 0; i < frames; i++) out[i] *= amplitude;
+  }
+
+ private:
+  PAudioWave subwave;
+  float amplitude;
+  double frequency;
+};
+
+PAudioWave reshape(PAudioWave subwave, double amplitude, double frequency) {
+  return std::make_unique<ReshapeWave>(std::move(subwave), amplitude,
+                                       frequency);
+}
+
+class SilentWave : public AudioWave {
+ public:
+  void process(double dt, float* out, size_t frames) override {
+    std::fill(out, out + frames, 0.0f);
+  }
+};
+
+PAudioWave silence() { return std::make_unique<SilentWave>(); }
+
+class AddWave : public AudioWave {
+ public:
+  AddWave(PAudioWave a, PAudioWave b) : a(std::move(a)), b(std::move(b)) {}
+
+  void process(double dt, float* out, size_t frames) override {
+    DVC_ASSERT_LE(frames, max_block_frames);
+    a->process(dt, out, frames);
+    b->process(dt, scratch.data(), frames);
+    for (size_t i = 0; i < frames; i++) out[i] += scratch[i];
+  }
+
+ private:
+  PAudioWave a, b;
+  // Preallocated so that rendering never allocates on the audio thread.
+  std::array<float, max_block_frames> scratch;
+};
+
+PAudioWave operator+(PAudioWave a, PAudioWave b) {
+  return std::make_unique<AddWave>(std::move(a), std::move(b));
+}
+
+void Envelope::apply(const Adsr& adsr, float dt, float* out, size_t frames) {
+  for (size_t i = 0; i < frames; i++) {
+    if (stage == Stage::attack) {
+      gain += dt / adsr.attack;
+      if (gain >= 1) {
+        gain = 1;
+        stage = Stage::decay;
+      }
+    } else if (stage == Stage::decay) {
+      gain -= dt * (1 - adsr.sustain) / adsr.decay;
+      if (gain <= adsr.sustain) {
+        gain = adsr.sustain;
+        stage = Stage::sustain;
+      }
+    } else if (stage == Stage::release) {
+      gain -= dt / adsr.release;
+      if (gain <= 0) {
+        gain = 0;
+        stage = Stage::idle;
+      }
+    }
+    out[i] *= gain;
+  }
+}
+
+void VoicePool::process(double dt, float* out, size_t frames) {
+  DVC_ASSERT_LE(frames, max_block_frames);
+  for (NoteEvent event; events.pop(event);) {
+    if (event.on)
+      start(event);
+    else
+      release(event.note);
+  }
+
+  std::fill(out, out + frames, 0.0f);
+  for (Voice& voice : voices) {
+    if (!voice.envelope.active()) continue;
+    const double step = voice.frequency * dt;
+    render_waveform(voice.waveform, voice.phase, step, scratch.data(),
+                    frames);
+    voice.phase += frames * step;
+    voice.phase -= std::floor(voice.phase);
+    voice.envelope.apply(adsr, dt, scratch.data(), frames);
+    for (size_t i = 0; i < frames; i++)
+      out[i] += voice.amplitude * scratch[i];
+  }
+}
+
+void VoicePool::start(const NoteEvent& event) {
+  // Idle voices first, then released ones, each quietest first.
+  Voice* chosen = &voices[0];
+  auto priority = [](const Voice& voice) {
+    if (!voice.envelope.active()) return -1.0f;
+    return voice.envelope.level() + (voice.envelope.releasing() ? 0 : 1);
+  };
+  for (Voice& voice : voices)
+    if (priority(voice) < priority(*chosen)) chosen = &voice;
+  // A stolen voice keeps its phase, since its envelope carries on from its
+  // current level and restarting the waveform under it would click.
+  if (!chosen->envelope.active()) chosen->phase = 0;
+  chosen->note = event.note;
+  chosen->waveform = event.waveform;
+  chosen->frequency = event.frequency;
+  chosen->amplitude = event.amplitude;
+  chosen->envelope.start();
+}
+
+void VoicePool::release(int note) {
+  for (Voice& voice : voices)
+    if (voice.note == note && !voice.envelope.releasing())
+      voice.envelope.release();
+}
+
+std::vector<float> render_offline(AudioWave& wave, uint32_t rate,
+                                  size_t frames) {
+  std::vector<float> samples(frames);
+  for (size_t i = 0; i < frames; i += max_block_frames)
+    wave.process(1.0 / rate, &samples[i],
+                 std::min(max_block_frames, frames - i));
+  return samples;
+}
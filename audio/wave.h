@@ -0,0 +1,156 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Most frames a wave renders per process() call.
+constexpr size_t max_block_frames = 256;
+
+class AudioWave {
+ public:
+  virtual ~AudioWave() = default;
+
+  // Writes the next frames of the wave to out[0, frames), for frames <=
+  // max_block_frames, with the wave's time advancing dt per frame.
+  virtual void process(double dt, float* out, size_t frames) = 0;
+};
+using PAudioWave = std::unique_ptr<AudioWave>;
+
+// Periodic waves of period 1.
+PAudioWave round_wave();
+PAudioWave square_wave();
+PAudioWave triangle_wave();
+PAudioWave saw_wave();
+
+PAudioWave reshape(PAudioWave subwave, double amplitude, double frequency);
+PAudioWave silence();
+PAudioWave operator+(PAudioWave a, PAudioWave b);
+
+enum class Waveform { sine, square, triangle, saw };
+
+Waveform parse_waveform(const std::string& name);
+
+// Writes waveform from phase start, advancing by step each frame.
+void render_waveform(Waveform waveform, float start, float step, float* out,
+                     size_t frames);
+
+// Queue between one producer thread and one consumer thread that never
+// blocks or allocates.  Holds up to capacity - 1 items.
+template <typename T, size_t capacity>
+class SpscQueue {
+ public:
+  // Called by the producer.  False if the queue is full.
+  bool push(const T& item) {
+    const size_t back = tail.load(std::memory_order_relaxed);
+    const size_t next = (back + 1) % capacity;
+    if (next == head.load(std::memory_order_acquire)) return false;
+    items[back] = item;
+    tail.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // Called by the consumer.  False if the queue is empty.
+  bool pop(T& item) {
+    const size_t front = head.load(std::memory_order_relaxed);
+    if (front == tail.load(std::memory_order_acquire)) return false;
+    item = items[front];
+    head.store((front + 1) % capacity, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  std::array<T, capacity> items;
+  // On separate cache lines, as each is written by a different thread.
+  alignas(64) std::atomic<size_t> head = 0;
+  alignas(64) std::atomic<size_t> tail = 0;
+};
+
+// Attack, decay and release times in seconds, and the sustain level.
+struct Adsr {
+  float attack = 0.005;
+  float decay = 0.1;
+  float sustain = 0.7;
+  float release = 0.2;
+};
+
+// Piecewise linear gain following an Adsr, so that notes start and stop
+// without clicks.
+class Envelope {
+ public:
+  // Attacks from the current level, which is nonzero for a stolen voice.
+  void start() { stage = Stage::attack; }
+  void release() {
+    if (stage != Stage::idle) stage = Stage::release;
+  }
+  bool active() const { return stage != Stage::idle; }
+  bool releasing() const { return stage == Stage::release; }
+  float level() const { return gain; }
+
+  // Multiplies out[0, frames) by the envelope, dt seconds apart.
+  void apply(const Adsr& adsr, float dt, float* out, size_t frames);
+
+ private:
+  enum class Stage { idle, attack, decay, sustain, release };
+  Stage stage = Stage::idle;
+  float gain = 0;
+};
+
+// A fixed set of enveloped oscillators, played by note_on and note_off
+// from one other thread.  Events reach the audio thread through a queue
+// drained at the start of each block, so a note starts within one block
+// and nothing allocates or locks once the pool is built.
+class VoicePool : public AudioWave {
+ public:
+  static constexpr size_t max_voices = 16;
+
+  explicit VoicePool(Adsr adsr = {}) : adsr(adsr) {}
+
+  // Starts note, stealing the quietest voice if all are in use.  False if
+  // the event queue is full.
+  bool note_on(int note, Waveform waveform, float frequency, float amplitude) {
+    return events.push({note, true, waveform, frequency, amplitude});
+  }
+
+  // Releases note.  False if the event queue is full.
+  bool note_off(int note) { return events.push({note, false}); }
+
+  void process(double dt, float* out, size_t frames) override;
+
+ private:
+  struct NoteEvent {
+    int note;
+    bool on;
+    Waveform waveform;
+    float frequency;
+    float amplitude;
+  };
+
+  struct Voice {
+    int note = -1;
+    Waveform waveform = Waveform::sine;
+    double frequency = 0;
+    float amplitude = 0;
+    // In [0, 1), carried from block to block.
+    double phase = 0;
+    Envelope envelope;
+  };
+
+  void start(const NoteEvent& event);
+  void release(int note);
+
+  const Adsr adsr;
+  std::array<Voice, max_voices> voices;
+  SpscQueue<NoteEvent, 64> events;
+  std::array<float, max_block_frames> scratch;
+};
+
+// Renders frames frames of wave at rate frames per second, a block at a
+// time as the audio callback does, but without a device and as fast as
+// the wave allows.
+std::vector<float> render_offline(AudioWave& wave, uint32_t rate,
+                                  size_t frames);
@@ -0,0 +1,60 @@
+#include <cmath>
+
+#include "audio/wave.h"
+#include "dvc/program.h"
+
+int main() {
+  dvc::program program;
+
+  for (float sample : render_offline(*silence(), 48000, 1000))
+    DVC_ASSERT_EQ(sample, 0.0f);
+
+  // Accumulated phase stays accurate over many blocks.
+  PAudioWave sine = reshape(round_wave(), 0.5, 1000);
+  const std::vector<float> samples = render_offline(*sine, 48000, 480000);
+  for (size_t i = 0; i < samples.size(); i++)
+    DVC_ASSERT_LT(std::abs(samples[i] - 0.5 * std::sin(2 * M_PI * i / 48)),
+                  1e-4);
+
+  // Band limiting does not overshoot the square wave's range.
+  PAudioWave square = reshape(square_wave(), 1, 1000);
+  for (float sample : render_offline(*square, 48000, 4800))
+    DVC_ASSERT_LE(std::abs(sample), 1.0f);
+
+  // Notes rise and fall without clicks and end in silence.
+  VoicePool pool;
+  DVC_ASSERT(pool.note_on(0, Waveform::sine, 440, 0.5));
+  DVC_ASSERT(pool.note_on(1, Waveform::triangle, 660, 0.25));
+  std::vector<float> held = render_offline(pool, 48000, 24000);
+  DVC_ASSERT(pool.note_off(0));
+  DVC_ASSERT(pool.note_off(1));
+  std::vector<float> released = render_offline(pool, 48000, 24000);
+  held.insert(held.end(), released.begin(), released.end());
+  float loudest = 0;
+  for (size_t i = 1; i < held.size(); i++) {
+    DVC_ASSERT_LT(std::abs(held[i] - held[i - 1]), 0.05);
+    loudest = std::max(loudest, std::abs(held[i]));
+  }
+  DVC_ASSERT_GT(loudest, 0.5);
+  DVC_ASSERT_EQ(held.back(), 0.0f);
+
+  // Stealing a sounding voice for another note does not click either.  The
+  // first voice, the one stolen, is a quarter cycle in when it is.
+  VoicePool full;
+  DVC_ASSERT(full.note_on(0, Waveform::sine, 202.5, 0.5));
+  for (int note = 1; note < int(VoicePool::max_voices); note++)
+    DVC_ASSERT(full.note_on(note, Waveform::sine, 200 + 10 * note, 0.01));
+  std::vector<float> before = render_offline(full, 48000, 4800);
+  DVC_ASSERT(full.note_on(100, Waveform::sine, 400, 0.5));
+  std::vector<float> after = render_offline(full, 48000, 4800);
+  before.insert(before.end(), after.begin(), after.end());
+  for (size_t i = 1; i < before.size(); i++)
+    DVC_ASSERT_LT(std::abs(before[i] - before[i - 1]), 0.05);
+
+  // The event queue holds capacity - 1 events until the pool drains it.
+  VoicePool busy;
+  for (int note = 0; note < 63; note++) DVC_ASSERT(busy.note_off(note));
+  DVC_ASSERT(!busy.note_off(63));
+  render_offline(busy, 48000, 1);
+  DVC_ASSERT(busy.note_off(63));
+}
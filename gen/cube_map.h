@@ -1,49 +1,203 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <png++/png.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dvc/log.h"
+#include "dvc/string.h"
+#include "gen/ktx2.h"
+
+// Calls f(i) for every i in [0, n) from one thread per core.
+template <typename F>
+void parallel_for(size_t n, F f) {
+  std::atomic<size_t> next = 0;
+  auto worker = [&] {
+    for (size_t i; (i = next++) < n;) f(i);
+  };
+  std::vector<std::thread> threads(
+      std::max(1u, std::thread::hardware_concurrency()) - 1);
+  for (std::thread& thread : threads) thread = std::thread(worker);
+  worker();
+  for (std::thread& thread : threads) thread.join();
+}
+
+// Filter used to reduce oversampled faces and to build the mip chain.
+enum class Filter { box, lanczos };
+
+inline Filter parse_filter(const std::string& name) {
+  if (name == "box") return Filter::box;
+  if (name == "lanczos") return Filter::lanczos;
+  DVC_FAIL("Unknown filter: ", name);
+}
+
+// Weights for resampling a row of src texels to dst texels (dst < src).  A
+// box filter weighs each source texel by its overlap with the destination
+// texel; Lanczos-3 is stretched to the destination texel size.
+struct Resampler {
+  Resampler(uint32_t src, uint32_t dst, Filter filter)
+      : first(dst), weights(dst) {
+    const double scale = double(src) / dst;
+    const double radius = filter == Filter::box ? scale / 2 : 3 * scale;
+    for (uint32_t i = 0; i < dst; i++) {
+      const double center = (i + 0.5) * scale;
+      const int64_t lo = std::max<int64_t>(0, std::floor(center - radius));
+      const int64_t hi = std::min<int64_t>(src, std::ceil(center + radius));
+      first[i] = lo;
+      double total = 0;
+      for (int64_t j = lo; j < hi; j++) {
+        double weight;
+        if (filter == Filter::box) {
+          weight = std::max(0.0, std::min(j + 1.0, center + radius) -
+                                     std::max(double(j), center - radius));
+        } else {
+          const double x = (j + 0.5 - center) / scale;
+          weight = lanczos(x);
+        }
+        weights[i].push_back(weight);
+        total += weight;
+      }
+      for (float& weight : weights[i]) weight /= total;
+    }
+  }
+
+  static double lanczos(double x) {
+    if (x == 0) return 1;
+    if (std::abs(x) >= 3) return 0;
+    const double px = M_PI * x;
+    return 3 * std::sin(px) * std::sin(px / 3) / (px * px);
+  }
+
+  std::vector<uint32_t> first;
+  std::vector<std::vector<float>> weights;
+};
+
+// Reduces a src x src image to dst x dst, rows then columns.
+inline std::vector<glm::vec3> resample(const std::vector<glm::vec3>& image,
+                                       uint32_t src, uint32_t dst,
+                                       Filter filter) {
+  const Resampler resampler(src, dst, filter);
+  std::vector<glm::vec3> rows(size_t(dst) * src);
+  parallel_for(dst, [&](size_t x) {
+    glm::vec3* row = &rows[x * src];
+    for (size_t k = 0; k < resampler.weights[x].size(); k++) {
+      const glm::vec3* in = &image[(resampler.first[x] + k) * src];
+      for (uint32_t y = 0; y < src; y++)
+        row[y] += resampler.weights[x][k] * in[y];
+    }
+  });
+  std::vector<glm::vec3> result(size_t(dst) * dst);
+  parallel_for(dst, [&](size_t x) {
+    for (uint32_t y = 0; y < dst; y++) {
+      glm::vec3 sum(0);
+      const glm::vec3* in = &rows[x * src + resampler.first[y]];
+      for (size_t k = 0; k < resampler.weights[y].size(); k++)
+        sum += resampler.weights[y][k] * in[k];
+      result[x * dst + y] = sum;
+    }
+  });
+  return result;
+}
+
+// Six width x width faces and their mip chain, shaded at oversample x
+// oversample samples per texel.  Faces are in Vulkan cube map order and
+// orientation (+X, -X, +Y, -Y, +Z, -Z, first row at the top) so that the
+// levels can be uploaded as they are.
 struct CubeMap {
-  CubeMap(uint32_t width, uint32_t oversample) : images(6, {width, width}) {}
+  CubeMap(uint32_t width, uint32_t oversample, Filter filter = Filter::box)
+      : width(width),
+        oversample(oversample),
+        filter(filter),
+        levels(std::log2(width) + 1) {
+    DVC_ASSERT_GT(width, 0);
+    DVC_ASSERT_GT(oversample, 0);
+  }
+
+  // Face f covers directions face_normal[f] + t.x * face_u[f] +
+  // t.y * face_v[f] for t in [-1, 1]^2, with t.x along rows and t.y along
+  // columns.
+  static inline const glm::vec3 face_normal[6] = {
+      {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+  static inline const glm::vec3 face_u[6] = {
+      {0, -1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}, {0, -1, 0}, {0, -1, 0}};
+  static inline const glm::vec3 face_v[6] = {
+      {0, 0, -1}, {0, 0, 1}, {1, 0, 0}, {1, 0, 0}, {1, 0, 0}, {-1, 0, 0}};
 
-  std::vector<png::image<png::rgba_pixel>> images;
+  uint32_t width, oversample;
+  Filter filter;
+  // levels[l] is the RGBA8 texels of every face of level l, face by face.
+  std::vector<std::string> levels;
 
+  // Samples along each edge of a face.
+  uint32_t samples() const { return width * oversample; }
+
+  uint32_t level_width(size_t level) const {
+    return std::max(1u, width >> level);
+  }
+
+  // Direction through the center of sample (x, y) of face.
+  glm::vec3 direction(size_t face, size_t x, size_t y) const {
+    glm::vec2 t =
+        ((glm::vec2(x, y) + 0.5f) * (1.0f / samples())) * 2.0f - 1.0f;
+    return normalize(face_normal[face] + t.x * face_u[face] +
+                     t.y * face_v[face]);
+  }
+
+  // Shades every sample with f(face, x, y), then filters the samples down
+  // to each level.  f is called concurrently from several threads.
   template <typename F>
-  void shade_fragments(F f) {
-    for (size_t face = 0; face < 6; face++)
-      for (size_t x = 0; x < width; x++)
-        for (size_t y = 0; y < width; y++) {
-          glm::vec2 t =
-              ((glm::vec2(x, y) + 0.5f) * (1.0f / width)) * 2.0f - 1.0f;
-          glm::vec3 direction;
-          switch (face) {
-            case 0:
-              direction = glm::vec3(t.x, t.y, 1);
-              break;
-            case 1:
-              direction = glm::vec3(t.x, t.y, -1);
-              break;
-            case 2:
-              direction = glm::vec3(1, t.x, t.y);
-              break;
-            case 3:
-              direction = glm::vec3(-1, t.x, t.y);
-              break;
-            case 4:
-              direction = glm::vec3(t.y, 1, t.x);
-              break;
-            case 5:
-              direction = glm::vec3(t.y, -1, t.x);
-              break;
-          }
-          direction = normalize(direction);
-          glm::vec3 color;
-          color = f(direction);
-
-          images[face][x][y] = {uint8_t(255 * color.r), uint8_t(255 * color.g),
-                                uint8_t(255 * color.b), 255};
+  void shade_texels(F f) {
+    for (std::string& level : levels) level.clear();
+    const uint32_t n = samples();
+    for (size_t face = 0; face < 6; face++) {
+      std::vector<glm::vec3> image(size_t(n) * n);
+      parallel_for(n, [&](size_t x) {
+        for (size_t y = 0; y < n; y++)
+          image[x * n + y] = glm::clamp(f(face, x, y), 0.0f, 1.0f);
+      });
+      if (oversample > 1) image = resample(image, n, width, filter);
+      for (size_t level = 0; level < levels.size(); level++) {
+        if (level > 0)
+          image = resample(image, level_width(level - 1), level_width(level),
+                           filter);
+        for (glm::vec3 color : image) {
+          color = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+          levels[level] += {char(uint8_t(color.r)), char(uint8_t(color.g)),
+                            char(uint8_t(color.b)), char(255)};
         }
+      }
+    }
   }
 
+  // Shades every sample with f(direction) for its unit direction.
+  template <typename F>
+  void shade_fragments(F f) {
+    shade_texels([&](size_t face, size_t x, size_t y) {
+      return f(direction(face, x, y));
+    });
+  }
+
+  // Writes level 0 as basename0.png to basename5.png.
   void write(const std::string basename) {
-    for (size_t i = 0; i < images.size(); i++)
-      images[i].write(dvc::concat(basename, i, ".png"));
+    const size_t face_size = size_t(width) * width * 4;
+    for (size_t face = 0; face < 6; face++) {
+      png::image<png::rgba_pixel> image(width, width);
+      const char* texel = levels[0].data() + face * face_size;
+      for (size_t x = 0; x < width; x++)
+        for (size_t y = 0; y < width; y++, texel += 4)
+          image[x][y] = {png::byte(texel[0]), png::byte(texel[1]),
+                         png::byte(texel[2]), png::byte(texel[3])};
+      image.write(dvc::concat(basename, face, ".png"));
+    }
+  }
+
+  // Writes every face and level as a KTX2 cube map.
+  void write_ktx2(const std::filesystem::path& path) {
+    ktx2::save_cube(path, width, levels, true);
   }
 };
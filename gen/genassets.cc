@@ -0,0 +1,185 @@
+#include <openssl/evp.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "dvc/file.h"
+#include "dvc/opts.h"
+#include "dvc/program.h"
+#include "resource/resource.h"
+
+// Builds a resource file from generated assets, running a generator only
+// when its artifact is not already in the cache.
+//
+// MANIFEST: one asset per line, blank lines and '#' comments ignored
+//     NAME TOOL ARG*
+// NAME is the asset's path in the resource file.  TOOL is run from
+// --tool_dir with the ARGs, each "$out" replaced by the file it must write.
+//
+// Artifacts are stored as CACHE_DIR/HASH.EXT, where EXT is NAME's extension
+// (tools choose their output format by it) and HASH is the SHA-256 of the
+// tool binary, the ARGs and the contents of every ARG (or --option=ARG)
+// that names a file.  A changed generator, option, seed or input file gives
+// a new HASH; anything else reuses the artifact.
+
+std::filesystem::path DVC_OPTION(manifest, m, dvc::required, "asset manifest");
+std::filesystem::path DVC_OPTION(cache_dir, -, dvc::required,
+                                 "directory of generated artifacts");
+std::filesystem::path DVC_OPTION(tool_dir, -, "",
+                                 "directory of the generator binaries, by "
+                                 "default the one containing genassets");
+std::filesystem::path DVC_OPTION(outfile, o, dvc::required,
+                                 "output resource file");
+
+struct Asset {
+  std::string name;
+  std::string tool;
+  std::vector<std::string> args;
+};
+
+std::vector<Asset> parse_manifest(const std::filesystem::path& path) {
+  std::vector<Asset> assets;
+  std::istringstream in(dvc::load_file(path));
+  std::string line;
+  for (size_t line_number = 1; std::getline(in, line); line_number++) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream words(line);
+    Asset asset;
+    if (!(words >> asset.name)) continue;
+    if (!(words >> asset.tool))
+      DVC_FAIL(path, ":", line_number, ": expected NAME TOOL ARG*");
+    for (std::string arg; words >> arg;) asset.args.push_back(arg);
+    assets.push_back(asset);
+  }
+  return assets;
+}
+
+class Sha256 {
+ public:
+  Sha256() : context(EVP_MD_CTX_new(), EVP_MD_CTX_free) {
+    DVC_ASSERT(EVP_DigestInit_ex(context.get(), EVP_sha256(), nullptr));
+  }
+
+  // Adds data, length first so that consecutive fields cannot run together.
+  void add(std::string_view data) {
+    const uint64_t size = data.size();
+    DVC_ASSERT(EVP_DigestUpdate(context.get(), &size, sizeof(size)));
+    DVC_ASSERT(EVP_DigestUpdate(context.get(), data.data(), data.size()));
+  }
+
+  std::string hex() {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int size;
+    DVC_ASSERT(EVP_DigestFinal_ex(context.get(), digest, &size));
+    std::string result;
+    for (unsigned int i = 0; i < size; i++) {
+      result += "0123456789abcdef"[digest[i] >> 4];
+      result += "0123456789abcdef"[digest[i] & 15];
+    }
+    return result;
+  }
+
+ private:
+  std::unique_ptr<EVP_MD_CTX, void (*)(EVP_MD_CTX*)> context;
+};
+
+// The file named by arg or by the value of an --option=value arg, if any.
+// A value with a '/' other than $out names a file, which must exist, so
+// that a missing input fails here rather than leaving it out of the hash.
+std::optional<std::filesystem::path> input_file(const std::string& arg) {
+  std::string value = arg;
+  if (arg.rfind("--", 0) == 0 && arg.find('=') != std::string::npos)
+    value = arg.substr(arg.find('=') + 1);
+  if (std::filesystem::is_regular_file(value)) return value;
+  if (value.find('/') != std::string::npos &&
+      value.find("$out") == std::string::npos)
+    DVC_FAIL("No such input file: ", value);
+  return std::nullopt;
+}
+
+std::string asset_hash(const std::filesystem::path& tool,
+                       const Asset& asset) {
+  Sha256 sha;
+  sha.add(dvc::load_file(tool));
+  for (const std::string& arg : asset.args) {
+    sha.add(arg);
+    if (std::optional<std::filesystem::path> file = input_file(arg))
+      sha.add(dvc::load_file(*file));
+  }
+  return sha.hex();
+}
+
+std::string shell_quote(const std::string& arg) {
+  std::string quoted = "'";
+  for (char c : arg) {
+    if (c == '\'')
+      quoted += "'\\''";
+    else
+      quoted += c;
+  }
+  return quoted + "'";
+}
+
+// Runs tool to produce artifact, via a temporary file so that a failed or
+// interrupted run never leaves a partial artifact in the cache.
+void generate(const std::filesystem::path& tool, const Asset& asset,
+              const std::filesystem::path& artifact) {
+  std::filesystem::path partial = artifact;
+  partial.replace_extension(".partial" + artifact.extension().string());
+  std::string command = shell_quote(tool.string());
+  for (std::string arg : asset.args) {
+    for (size_t pos; (pos = arg.find("$out")) != std::string::npos;)
+      arg.replace(pos, 4, partial.string());
+    command += " " + shell_quote(arg);
+  }
+  DVC_LOG("generating ", asset.name, ": ", command);
+  remove(partial);
+  if (std::system(command.c_str()) != 0)
+    DVC_FAIL("Generator failed for ", asset.name, ": ", command);
+  if (!exists(partial))
+    DVC_FAIL("Generator did not write $out for ", asset.name);
+  rename(partial, artifact);
+}
+
+int main(int argc, char** argv) {
+  dvc::program program(argc, argv);
+
+  const std::filesystem::path tools =
+      tool_dir.empty() ? std::filesystem::absolute(argv[0]).parent_path()
+                       : tool_dir;
+  create_directories(cache_dir);
+
+  const std::filesystem::path staging = cache_dir / "staging";
+  remove_all(staging);
+  create_directory(staging);
+
+  size_t num_generated = 0;
+  for (const Asset& asset : parse_manifest(manifest)) {
+    const std::filesystem::path tool = tools / asset.tool;
+    if (!is_regular_file(tool)) DVC_FAIL("No such tool: ", tool);
+
+    std::filesystem::path artifact = cache_dir / asset_hash(tool, asset);
+    artifact += std::filesystem::path(asset.name).extension();
+    if (exists(artifact)) {
+      DVC_LOG("cached ", asset.name, ": ", artifact);
+    } else {
+      generate(tool, asset, artifact);
+      num_generated++;
+    }
+
+    const std::filesystem::path staged = staging / asset.name;
+    create_directories(staged.parent_path());
+    std::error_code error;
+    create_hard_link(artifact, staged, error);
+    if (error) copy_file(artifact, staged);
+  }
+
+  ResourceWriter(staging, outfile);
+  remove_all(staging);
+  DVC_LOG("wrote ", outfile, ", ", num_generated, " assets generated");
+}
@@ -1,26 +1,28 @@
 #include "dvc/program.h"
 
 #include <glm/glm.hpp>
-#include <png++/png.hpp>
-#include <random>
 
 #include "dvc/opts.h"
+#include "gen/cube_map.h"
+#include "gen/random.h"
 
 uint32_t DVC_OPTION(width, -, dvc::required, "image face width");
 size_t DVC_OPTION(num_stars, -, dvc::required, "number of stars");
 float DVC_OPTION(limit, -, dvc::required, "limit to display in rads");
-
-float random_signed_uniform() {
-  thread_local std::random_device random_device;
-  thread_local std::mt19937 mt19937(random_device());
-  thread_local std::uniform_real_distribution<float> distribution(-1, 1);
-  return distribution(mt19937);
-}
-
-glm::vec3 random_sphere_point() {
+uint64_t DVC_OPTION(seed, -, 0, "random seed for star placement");
+uint32_t DVC_OPTION(oversample, -, 1, "samples per texel along each axis");
+std::string DVC_OPTION(filter, -, "box",
+                       "oversampling and mip filter: box or lanczos");
+std::filesystem::path DVC_OPTION(output_dir, -, ".",
+                                 "directory to write face0.png to face5.png");
+std::string DVC_OPTION(ktx2_output, -, "",
+                       "write all faces and mip levels to this KTX2 file "
+                       "instead of PNG faces");
+
+glm::vec3 random_sphere_point(Random& random) {
   while (true) {
-    glm::vec3 point = {random_signed_uniform(), random_signed_uniform(),
-                       random_signed_uniform()};
+    glm::vec3 point = {random.signed_unit(), random.signed_unit(),
+                       random.signed_unit()};
     if (length(point) <= 1) return point;
   }
 }
@@ -28,8 +30,8 @@ glm::vec3 random_sphere_point() {
 float angle(glm::vec3 a, glm::vec3 b) { return std::acos(dot(a, b)); }
 
 struct Star {
-  Star()
-      : location(random_sphere_point()),
+  explicit Star(Random random)
+      : location(random_sphere_point(random)),
         mag(length(location)),
         direction(normalize(location)) {}
 
@@ -42,60 +44,14 @@ struct Star {
   glm::vec3 direction;
 };
 
-struct CubeMap {
-  CubeMap() : images(6, {width, width}) {}
-
-  std::vector<png::image<png::rgba_pixel>> images;
-
-  template <typename F>
-  void shade_fragments(F f) {
-    for (size_t face = 0; face < 6; face++)
-      for (size_t x = 0; x < width; x++)
-        for (size_t y = 0; y < width; y++) {
-          glm::vec2 t =
-              ((glm::vec2(x, y) + 0.5f) * (1.0f / width)) * 2.0f - 1.0f;
-          glm::vec3 direction;
-          switch (face) {
-            case 0:
-              direction = glm::vec3(t.x, t.y, 1);
-              break;
-            case 1:
-              direction = glm::vec3(t.x, t.y, -1);
-              break;
-            case 2:
-              direction = glm::vec3(1, t.x, t.y);
-              break;
-            case 3:
-              direction = glm::vec3(-1, t.x, t.y);
-              break;
-            case 4:
-              direction = glm::vec3(t.y, 1, t.x);
-              break;
-            case 5:
-              direction = glm::vec3(t.y, -1, t.x);
-              break;
-          }
-          direction = normalize(direction);
-          glm::vec3 color;
-          color = f(direction);
-
-          images[face][x][y] = {uint8_t(255 * color.r), uint8_t(255 * color.g),
-                                uint8_t(255 * color.b), 255};
-        }
-  }
-
-  void write(const std::string basename) {
-    for (size_t i = 0; i < images.size(); i++)
-      images[i].write(dvc::concat(basename, i, ".png"));
-  }
-};
-
 int main(int argc, char** argv) {
   dvc::program program(argc, argv);
 
-  CubeMap cube_map;
+  CubeMap cube_map(width, oversample, parse_filter(filter));
 
-  const std::vector<Star> stars(num_stars);
+  // Star i depends only on (seed, i).
+  std::vector<Star> stars;
+  for (size_t i = 0; i < num_stars; i++) stars.emplace_back(Random(seed, i));
 
   size_t num_groups = std::sqrt(num_stars);
 
@@ -133,5 +89,8 @@ int main(int argc, char** argv) {
     return {0, 0, 0};
   });
 
-  cube_map.write("/home/zos/face");
+  if (ktx2_output.empty())
+    cube_map.write((output_dir / "face").string());
+  else
+    cube_map.write_ktx2(ktx2_output);
 }
@@ -1,26 +1,34 @@
 #include "dvc/program.h"
 
+#include <algorithm>
+#include <cmath>
 #include <glm/glm.hpp>
-#include <png++/png.hpp>
-#include <random>
+#include <unordered_map>
 
 #include "dvc/opts.h"
+#include "gen/cube_map.h"
+#include "gen/random.h"
 
 uint32_t DVC_OPTION(width, -, dvc::required, "image face width");
 size_t DVC_OPTION(num_stars, -, dvc::required, "number of stars");
 float DVC_OPTION(limit, -, dvc::required, "limit to display in rads");
-
-float random_signed_uniform() {
-  thread_local std::random_device random_device;
-  thread_local std::mt19937 mt19937(random_device());
-  thread_local std::uniform_real_distribution<float> distribution(-1, 1);
-  return distribution(mt19937);
-}
-
-glm::vec3 random_sphere_point() {
+uint64_t DVC_OPTION(seed, -, 0, "random seed for star placement");
+bool DVC_OPTION(splat, -, false,
+                "scatter each star into the texels it covers instead of "
+                "searching for stars near each texel");
+uint32_t DVC_OPTION(oversample, -, 1, "samples per texel along each axis");
+std::string DVC_OPTION(filter, -, "box",
+                       "oversampling and mip filter: box or lanczos");
+std::filesystem::path DVC_OPTION(output_dir, -, ".",
+                                 "directory to write face0.png to face5.png");
+std::string DVC_OPTION(ktx2_output, -, "",
+                       "write all faces and mip levels to this KTX2 file "
+                       "instead of PNG faces");
+
+glm::vec3 random_sphere_point(Random& random) {
   while (true) {
-    glm::vec3 point = {random_signed_uniform(), random_signed_uniform(),
-                       random_signed_uniform()};
+    glm::vec3 point = {random.signed_unit(), random.signed_unit(),
+                       random.signed_unit()};
     if (length(point) <= 1) return point;
   }
 }
@@ -28,8 +36,8 @@ glm::vec3 random_sphere_point() {
 float angle(glm::vec3 a, glm::vec3 b) { return std::acos(dot(a, b)); }
 
 struct Star {
-  Star()
-      : location(random_sphere_point()),
+  explicit Star(Random random)
+      : location(random_sphere_point(random)),
         mag(length(location)),
         direction(normalize(location)) {}
 
@@ -42,96 +50,148 @@ struct Star {
   glm::vec3 direction;
 };
 
-struct CubeMap {
-  CubeMap() : images(6, {width, width}) {}
-
-  std::vector<png::image<png::rgba_pixel>> images;
+// Buckets unit directions into a sparse 3D grid over [-1, 1]^3.  Cells are
+// at least as wide as the chord subtended by radius, so every direction
+// within radius of a query lies in the 3x3x3 cells around the query's cell.
+class DirectionIndex {
+ public:
+  DirectionIndex(const std::vector<glm::vec3>& directions, float radius)
+      : cell_size(1.001f * 2 * std::sin(std::min(radius, float(M_PI)) / 2) +
+                  1e-6f),
+        cells_per_axis(2 / cell_size + 2) {
+    std::vector<std::pair<uint64_t, uint32_t>> keyed(directions.size());
+    for (uint32_t i = 0; i < directions.size(); i++)
+      keyed[i] = {key(cell(directions[i])), i};
+    std::sort(keyed.begin(), keyed.end());
+
+    order.resize(keyed.size());
+    for (uint32_t i = 0; i < keyed.size(); i++) {
+      order[i] = keyed[i].second;
+      auto [it, inserted] = buckets.emplace(keyed[i].first, std::pair(i, i));
+      it->second.second = i + 1;
+    }
+  }
 
+  // Calls f(i) for every directions[i] that may be within radius of
+  // direction (and some that are not).
   template <typename F>
-  void shade_fragments(F f) {
-    for (size_t face = 0; face < 6; face++)
-      for (size_t x = 0; x < width; x++)
-        for (size_t y = 0; y < width; y++) {
-          glm::vec2 t =
-              ((glm::vec2(x, y) + 0.5f) * (1.0f / width)) * 2.0f - 1.0f;
-          glm::vec3 direction;
-          switch (face) {
-            case 0:
-              direction = glm::vec3(t.x, t.y, 1);
-              break;
-            case 1:
-              direction = glm::vec3(t.x, t.y, -1);
-              break;
-            case 2:
-              direction = glm::vec3(1, t.x, t.y);
-              break;
-            case 3:
-              direction = glm::vec3(-1, t.x, t.y);
-              break;
-            case 4:
-              direction = glm::vec3(t.y, 1, t.x);
-              break;
-            case 5:
-              direction = glm::vec3(t.y, -1, t.x);
-              break;
-          }
-          direction = normalize(direction);
-          glm::vec3 color;
-          color = f(direction);
-
-          images[face][x][y] = {uint8_t(255 * color.r), uint8_t(255 * color.g),
-                                uint8_t(255 * color.b), 255};
+  void for_each_near(glm::vec3 direction, F f) const {
+    const glm::ivec3 center = cell(direction);
+    for (int dx = -1; dx <= 1; dx++)
+      for (int dy = -1; dy <= 1; dy++)
+        for (int dz = -1; dz <= 1; dz++) {
+          auto it = buckets.find(key(center + glm::ivec3(dx, dy, dz)));
+          if (it == buckets.end()) continue;
+          for (uint32_t i = it->second.first; i < it->second.second; i++)
+            f(order[i]);
         }
   }
 
-  void write(const std::string basename) {
-    for (size_t i = 0; i < images.size(); i++)
-      images[i].write(dvc::concat(basename, i, ".png"));
+ private:
+  glm::ivec3 cell(glm::vec3 direction) const {
+    return glm::ivec3(glm::floor((direction + 1.0f) / cell_size)) + 1;
   }
-};
-
-int main(int argc, char** argv) {
-  dvc::program program(argc, argv);
-
-  CubeMap cube_map;
 
-  const std::vector<Star> stars(num_stars);
+  uint64_t key(glm::ivec3 cell) const {
+    return (uint64_t(cell.x) * cells_per_axis + cell.y) * cells_per_axis +
+           cell.z;
+  }
 
-  size_t num_groups = std::sqrt(num_stars);
+  float cell_size;
+  uint64_t cells_per_axis;
+  // Directions sorted by cell, and each occupied cell's range of them.
+  std::vector<uint32_t> order;
+  std::unordered_map<uint64_t, std::pair<uint32_t, uint32_t>> buckets;
+};
 
-  std::vector<std::vector<uint32_t>> groups(num_groups);
-  std::vector<float> group_spread(num_groups);
+// Range [first, last] of the n samples along one face axis whose centers
+// may lie in [t0, t1].
+std::pair<size_t, size_t> sample_range(uint32_t n, float t0, float t1) {
+  auto sample = [n](float t) { return (t + 1) / 2 * n - 0.5f; };
+  return {size_t(std::clamp(std::floor(sample(t0)), 0.0f, n - 1.0f)),
+          size_t(std::clamp(std::ceil(sample(t1)), 0.0f, n - 1.0f))};
+}
 
-  for (size_t star = 0; star < num_stars; star++) {
-    size_t closest_group = 0;
-    float best_angle = std::numeric_limits<float>::max();
-    for (size_t group = 0; group < num_groups; group++) {
-      float candidate_angle = stars[star].angle(stars[group].direction);
-      if (candidate_angle < best_angle) {
-        best_angle = candidate_angle;
-        closest_group = group;
+// Adds each star's falloff 1 - angle / limit into every cube map sample
+// within limit of it.  On each face the star's cone of radius limit meets the
+// face plane in an ellipse, and only the samples in that ellipse's bounding
+// box are visited.
+std::vector<float> splat_stars(const CubeMap& cube_map,
+                               const std::vector<Star>& stars) {
+  const uint32_t n = cube_map.samples();
+  std::vector<float> intensity(size_t(6) * n * n);
+  const float cos_limit = std::cos(limit);
+  const float reach = std::cos(
+      std::min(float(M_PI), limit + std::acos(1 / std::sqrt(3.0f))));
+  for (const Star& star : stars)
+    for (size_t face = 0; face < 6; face++) {
+      // Star direction in the face's (u, v, normal) basis.
+      const glm::vec3 a(dot(star.direction, CubeMap::face_u[face]),
+                        dot(star.direction, CubeMap::face_v[face]),
+                        dot(star.direction, CubeMap::face_normal[face]));
+      // Face directions are within acos(1 / sqrt(3)) of the face normal.
+      if (a.z < reach) continue;
+      glm::vec2 lo(-1), hi(1);
+      if (limit < M_PI / 2 && a.z > std::sin(limit)) {
+        // (x, y, 1) is in the cone iff p^T M p >= 0, and the lines x = k
+        // tangent to that conic satisfy l^T M^-1 l = 0 for l = (1, 0, -k).
+        glm::mat3 m(a.x * a, a.y * a, a.z * a);
+        for (int i = 0; i < 3; i++) m[i][i] -= cos_limit * cos_limit;
+        const glm::mat3 dual = inverse(m);
+        for (int i = 0; i < 2; i++) {
+          const float mid = dual[i][2] / dual[2][2];
+          const float half = std::sqrt(
+              std::max(0.0f, mid * mid - dual[i][i] / dual[2][2]));
+          lo[i] = std::max(-1.0f, mid - half);
+          hi[i] = std::min(1.0f, mid + half);
+        }
+        if (lo.x > hi.x || lo.y > hi.y) continue;
       }
-    }
-    groups[closest_group].push_back(star);
-    if (best_angle > group_spread[closest_group])
-      group_spread[closest_group] = best_angle;
-  }
 
-  cube_map.shade_fragments([&](glm::vec3 direction) -> glm::vec3 {
-    for (size_t group = 0; group < num_groups; group++) {
-      float group_center_angle = stars[group].angle(direction);
-      float group_min_angle = group_center_angle - group_spread[group];
-      if (group_min_angle < limit) {
-        for (size_t star : groups[group]) {
-          float star_angle = stars[star].angle(direction);
-          if (star_angle < limit) {
-            return glm::vec3(1 - star_angle / limit);
-          }
+      const auto [x0, x1] = sample_range(n, lo.x, hi.x);
+      const auto [y0, y1] = sample_range(n, lo.y, hi.y);
+      for (size_t x = x0; x <= x1; x++)
+        for (size_t y = y0; y <= y1; y++) {
+          const float angle = star.angle(cube_map.direction(face, x, y));
+          if (angle < limit)
+            intensity[(face * n + x) * n + y] += 1 - angle / limit;
         }
-      }
     }
-    return {0, 0, 0};
-  });
+  return intensity;
+}
+
+int main(int argc, char** argv) {
+  dvc::program program(argc, argv);
+
+  CubeMap cube_map(width, oversample, parse_filter(filter));
+
+  // Star i depends only on (seed, i).
+  std::vector<Star> stars;
+  for (size_t i = 0; i < num_stars; i++) stars.emplace_back(Random(seed, i));
+
+  if (splat) {
+    const std::vector<float> intensity = splat_stars(cube_map, stars);
+    const uint32_t n = cube_map.samples();
+    cube_map.shade_texels([&](size_t face, size_t x, size_t y) {
+      return glm::vec3(intensity[(face * n + x) * n + y]);
+    });
+  } else {
+    std::vector<glm::vec3> directions;
+    for (const Star& star : stars) directions.push_back(star.direction);
+    const DirectionIndex index(directions, limit);
+
+    cube_map.shade_fragments([&](glm::vec3 direction) -> glm::vec3 {
+      float intensity = 0;
+      index.for_each_near(direction, [&](uint32_t star) {
+        const float angle = stars[star].angle(direction);
+        if (angle < limit) intensity += 1 - angle / limit;
+      });
+      return glm::vec3(intensity);
+    });
+  }
 
-  cube_map.write("/home/zos/face");
+  if (ktx2_output.empty())
+    cube_map.write((output_dir / "face").string());
+  else
+    cube_map.write_ktx2(ktx2_output);
 }
@@ -0,0 +1,575 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <glm/glm.hpp>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <type_traits>
+#include <vector>
+
+#include "dvc/file.h"
+#include "dvc/log.h"
+
+// Precision of the tracer core, selected at compile time with
+// -DTRACER_REAL=float (see the tracer_float target).
+#ifndef TRACER_REAL
+#define TRACER_REAL double
+#endif
+
+using Real = TRACER_REAL;
+using Vec2 = glm::vec<2, Real>;
+using Vec3 = glm::vec<3, Real>;
+using Mat3 = glm::mat<3, 3, Real>;
+
+namespace glm {
+template <length_t L, typename T, qualifier Q>
+std::ostream& operator<<(std::ostream& o, vec<L, T, Q> v) {
+  o << "[ ";
+  for (length_t i = 0; i < L; i++) o << v[i] << " ";
+  o << "]";
+
+  return o;
+}
+}  // namespace glm
+
+using Color = Vec3;
+using Direction = Vec3;
+using Point = Vec3;
+
+struct Material {
+  Real specular;
+  Real diffuse;
+  Real ambient;
+  Real shininess;
+  Color color;
+  Real reflectance = 0;
+};
+
+struct Ray {
+  Point origin;
+  Direction dir;
+
+  Point at(Real t) const { return origin + t * dir; }
+};
+
+struct Hit {
+  Point point;
+  Direction normal;
+  Real distance;
+  // Index of the primitive within the object that was hit.
+  size_t primitive = 0;
+};
+
+class Object {
+ public:
+  virtual std::optional<Hit> collide(Ray ray) = 0;
+  virtual Material material(const Hit& hit) = 0;
+
+  // Whether anything is hit closer than max_distance.  Objects that can
+  // stop at the first such hit override this.
+  virtual bool occluded(Ray ray, Real max_distance) {
+    std::optional<Hit> hit = collide(ray);
+    return hit && hit->distance < max_distance;
+  }
+};
+
+// Per-thread render statistics.  Counters are always kept; the timers only
+// run when --stats_json or --heatmap asks for them.
+struct TraceStats {
+  uint64_t camera_rays = 0;
+  uint64_t shadow_rays = 0;
+  uint64_t shadow_occluded = 0;
+  uint64_t reflection_rays = 0;
+  uint64_t roulette_terminated = 0;
+  uint64_t intersection_tests = 0;
+  uint64_t hits = 0;
+  std::chrono::nanoseconds intersection_time{0};
+  // Time spent on the pixels of each --tile_rows x --tile_cols tile.
+  std::vector<std::chrono::nanoseconds> tile_time;
+
+  uint64_t rays() const { return camera_rays + shadow_rays + reflection_rays; }
+
+  std::chrono::nanoseconds pixel_time() const {
+    std::chrono::nanoseconds total{0};
+    for (std::chrono::nanoseconds t : tile_time) total += t;
+    return total;
+  }
+
+  void add(const TraceStats& other) {
+    camera_rays += other.camera_rays;
+    shadow_rays += other.shadow_rays;
+    shadow_occluded += other.shadow_occluded;
+    reflection_rays += other.reflection_rays;
+    roulette_terminated += other.roulette_terminated;
+    intersection_tests += other.intersection_tests;
+    hits += other.hits;
+    intersection_time += other.intersection_time;
+    tile_time.resize(std::max(tile_time.size(), other.tile_time.size()));
+    for (size_t i = 0; i < other.tile_time.size(); i++)
+      tile_time[i] += other.tile_time[i];
+  }
+};
+
+inline bool collect_timing = false;
+
+inline std::mutex all_stats_mutex;
+inline std::vector<std::unique_ptr<TraceStats>> all_stats;
+
+// The calling thread's statistics, registered on first use so that
+// total_stats() can sum them once the render is done.
+inline TraceStats& stats() {
+  thread_local TraceStats* thread_stats = [] {
+    std::lock_guard lock(all_stats_mutex);
+    all_stats.push_back(std::make_unique<TraceStats>());
+    return all_stats.back().get();
+  }();
+  return *thread_stats;
+}
+
+inline TraceStats total_stats() {
+  std::lock_guard lock(all_stats_mutex);
+  TraceStats total;
+  for (const auto& thread_stats : all_stats) total.add(*thread_stats);
+  return total;
+}
+
+// Adds the lifetime of the timer to *total, if total is not null.
+class ScopedTimer {
+ public:
+  ScopedTimer(std::chrono::nanoseconds* total)
+      : total(total),
+        start(total ? std::chrono::steady_clock::now()
+                    : std::chrono::steady_clock::time_point()) {}
+
+  ~ScopedTimer() {
+    if (total) *total += std::chrono::steady_clock::now() - start;
+  }
+
+ private:
+  std::chrono::nanoseconds* total;
+  std::chrono::steady_clock::time_point start;
+};
+
+// Distance along ray.dir (in units of |ray.dir|) to the nearest
+// intersection in front of the origin.
+inline std::optional<Real> intersect_sphere(Ray ray, Vec3 center, Real radius) {
+  const Real a = dot(ray.dir, ray.dir);
+  const Real b = dot(Real(2) * ray.dir, ray.origin - center);
+  const Real c =
+      dot(ray.origin - center, ray.origin - center) - radius * radius;
+
+  if (b * b < 4 * a * c) return std::nullopt;
+
+  const Real d = std::sqrt(b * b - 4 * a * c);
+
+  const Real t1 = (-b + d) / (2 * a);
+  const Real t2 = (-b - d) / (2 * a);
+
+  if (t1 < 0) {
+    if (t2 < 0)
+      return std::nullopt;
+    else
+      return t2;
+  } else {
+    if (t2 < 0)
+      return t1;
+    else
+      return std::min(t1, t2);
+  }
+}
+
+inline Hit sphere_hit(Ray ray, Real t, Vec3 center) {
+  Hit hit;
+  hit.point = ray.at(t);
+  hit.normal = normalize(hit.point - center);
+  hit.distance = distance(ray.origin, hit.point);
+  return hit;
+}
+
+class Sphere : public Object {
+ public:
+  Sphere(Vec3 center, Real radius, Material material)
+      : center(center), radius(radius), material_(material) {}
+
+  std::optional<Hit> collide(Ray ray) override {
+    stats().intersection_tests++;
+    std::optional<Real> t = intersect_sphere(ray, center, radius);
+
+    if (!t) return std::nullopt;
+
+    return sphere_hit(ray, *t, center);
+  }
+
+  Material material(const Hit& hit) override { return material_; }
+
+ private:
+  Vec3 center;
+  Real radius;
+  Material material_;
+};
+
+// Many spheres stored as flat arrays, filled in bulk from the scene script.
+class SphereSet : public Object {
+ public:
+  SphereSet(const std::vector<Material>& materials) : materials(materials) {}
+
+  std::optional<Hit> collide(Ray ray) override {
+    stats().intersection_tests += centers.size();
+    size_t nearest = centers.size();
+    Real nearest_t = std::numeric_limits<Real>::infinity();
+    for (size_t i = 0; i < centers.size(); i++) {
+      std::optional<Real> t = intersect_sphere(ray, centers[i], radii[i]);
+      if (t && *t < nearest_t) {
+        nearest = i;
+        nearest_t = *t;
+      }
+    }
+
+    if (nearest == centers.size()) return std::nullopt;
+
+    Hit hit = sphere_hit(ray, nearest_t, centers[nearest]);
+    hit.primitive = nearest;
+    return hit;
+  }
+
+  Material material(const Hit& hit) override {
+    return materials[material_ids[hit.primitive]];
+  }
+
+  std::vector<Vec3> centers;
+  std::vector<Real> radii;
+  std::vector<uint32_t> material_ids;
+
+ private:
+  const std::vector<Material>& materials;
+};
+
+// Triangle mesh loaded from an OBJ file, with a bounding volume hierarchy
+// over its triangles.  Meshes are immutable once built and shared by all
+// the MeshInstances that place them in the scene.
+class Mesh {
+ public:
+  Mesh(std::vector<Vec3> vertices,
+       std::vector<std::array<uint32_t, 3>> triangles)
+      : vertices(std::move(vertices)), triangles(std::move(triangles)) {
+    build_bvh();
+  }
+
+  // Reads the "v" and "f" records; polygons are split into triangle fans.
+  static std::shared_ptr<const Mesh> load_obj(
+      const std::filesystem::path& path) {
+    if (!exists(path)) DVC_FAIL("No such file: ", path);
+    std::istringstream in(dvc::load_file(path));
+    std::vector<Vec3> vertices;
+    std::vector<std::array<uint32_t, 3>> triangles;
+    std::string line;
+    for (size_t line_number = 1; std::getline(in, line); line_number++) {
+      std::istringstream fields(line);
+      std::string tag;
+      fields >> tag;
+      if (tag == "v") {
+        Vec3 v;
+        if (!(fields >> v.x >> v.y >> v.z))
+          DVC_FAIL(path, ":", line_number, ": bad vertex");
+        vertices.push_back(v);
+      } else if (tag == "f") {
+        std::vector<uint32_t> face;
+        std::string corner;
+        while (fields >> corner) {
+          // v, v/vt, v//vn or v/vt/vn; negative indices count from the end.
+          long index = std::strtol(corner.c_str(), nullptr, 10);
+          if (index < 0) index += vertices.size() + 1;
+          if (index < 1 || size_t(index) > vertices.size())
+            DVC_FAIL(path, ":", line_number, ": bad vertex index ", corner);
+          face.push_back(index - 1);
+        }
+        if (face.size() < 3) DVC_FAIL(path, ":", line_number, ": bad face");
+        for (size_t i = 2; i < face.size(); i++)
+          triangles.push_back({face[0], face[i - 1], face[i]});
+      }
+    }
+    if (triangles.empty()) DVC_FAIL(path, ": no faces");
+
+    auto mesh =
+        std::make_shared<Mesh>(std::move(vertices), std::move(triangles));
+    DVC_LOG("mesh ", path, ": ", mesh->vertices.size(), " vertices, ",
+            mesh->triangles.size(), " triangles, ", mesh->nodes.size(),
+            " bvh nodes");
+    return mesh;
+  }
+
+  // Finds the nearest triangle hit with t < t_max (in units of |ray.dir|),
+  // lowering t_max to it.  With any_hit, stops at the first hit found.
+  bool intersect(Ray ray, Real& t_max, uint32_t& triangle,
+                 bool any_hit) const {
+    const WatertightRay wray(ray);
+    const Vec3 inv_dir = Real(1) / ray.dir;
+    uint64_t tests = 0;
+    bool found = false;
+
+    uint32_t stack[64];
+    size_t stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0) {
+      const Node& node = nodes[stack[--stack_size]];
+      if (!intersect_box(node, ray.origin, inv_dir, t_max)) continue;
+      if (node.count == 0) {
+        // Visit the child on the near side of the split first.
+        const uint32_t left = &node - nodes.data() + 1, right = node.first;
+        const bool backwards = ray.dir[node.axis] < 0;
+        stack[stack_size++] = backwards ? left : right;
+        stack[stack_size++] = backwards ? right : left;
+        continue;
+      }
+      for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        tests++;
+        if (intersect_triangle(wray, i, t_max)) {
+          triangle = i;
+          found = true;
+          if (any_hit) break;
+        }
+      }
+      if (found && any_hit) break;
+    }
+
+    stats().intersection_tests += tests;
+    return found;
+  }
+
+  Vec3 normal(uint32_t triangle) const {
+    const std::array<uint32_t, 3>& tri = triangles[triangle];
+    return normalize(cross(vertices[tri[1]] - vertices[tri[0]],
+                           vertices[tri[2]] - vertices[tri[0]]));
+  }
+
+ private:
+  // Interior nodes have count == 0, their left child right after them and
+  // their right child at first.  Leaves hold triangles [first, first+count).
+  struct Node {
+    Vec3 lo, hi;
+    uint32_t first;
+    uint32_t count;
+    uint32_t axis;
+  };
+
+  static constexpr uint32_t max_leaf_size = 4;
+
+  // Per-ray setup of the watertight test (Woop, Benthin and Wald, "Watertight
+  // Ray/Triangle Intersection", JCGT 2013): the ray is sheared onto +z so
+  // edge tests are 2D and consistent between triangles sharing an edge.
+  struct WatertightRay {
+    WatertightRay(Ray ray) : origin(ray.origin) {
+      const Vec3 d = abs(ray.dir);
+      kz = d.x > d.y ? (d.x > d.z ? 0 : 2) : (d.y > d.z ? 1 : 2);
+      kx = (kz + 1) % 3;
+      ky = (kx + 1) % 3;
+      if (ray.dir[kz] < 0) std::swap(kx, ky);
+      sx = ray.dir[kx] / ray.dir[kz];
+      sy = ray.dir[ky] / ray.dir[kz];
+      sz = 1 / ray.dir[kz];
+    }
+
+    Point origin;
+    int kx, ky, kz;
+    Real sx, sy, sz;
+  };
+
+  bool intersect_triangle(const WatertightRay& ray, uint32_t triangle,
+                          Real& t_max) const {
+    const std::array<uint32_t, 3>& tri = triangles[triangle];
+    const Vec3 a = vertices[tri[0]] - ray.origin;
+    const Vec3 b = vertices[tri[1]] - ray.origin;
+    const Vec3 c = vertices[tri[2]] - ray.origin;
+    const Real ax = a[ray.kx] - ray.sx * a[ray.kz];
+    const Real ay = a[ray.ky] - ray.sy * a[ray.kz];
+    const Real bx = b[ray.kx] - ray.sx * b[ray.kz];
+    const Real by = b[ray.ky] - ray.sy * b[ray.kz];
+    const Real cx = c[ray.kx] - ray.sx * c[ray.kz];
+    const Real cy = c[ray.ky] - ray.sy * c[ray.kz];
+
+    Real u = cx * by - cy * bx;
+    Real v = ax * cy - ay * cx;
+    Real w = bx * ay - by * ax;
+    if constexpr (std::is_same_v<Real, float>) {
+      // Edge functions that round to exactly zero are redone in double so
+      // rays through shared edges and vertices are never lost.
+      if (u == 0 || v == 0 || w == 0) {
+        u = double(cx) * by - double(cy) * bx;
+        v = double(ax) * cy - double(ay) * cx;
+        w = double(bx) * ay - double(by) * ax;
+      }
+    }
+    if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0)) return false;
+
+    const Real det = u + v + w;
+    if (det == 0) return false;
+
+    // A ray exactly on an edge has a zero edge function in both triangles
+    // sharing it; only the triangle that owns the edge counts the hit.
+    if ((u == 0 && !owns_edge(bx, by, cx, cy, det)) ||
+        (v == 0 && !owns_edge(cx, cy, ax, ay, det)) ||
+        (w == 0 && !owns_edge(ax, ay, bx, by, det)))
+      return false;
+
+    const Real t = u * ray.sz * a[ray.kz] + v * ray.sz * b[ray.kz] +
+                   w * ray.sz * c[ray.kz];
+    // t / det must be in (0, t_max); compare without dividing.
+    if (det > 0 ? (t <= 0 || t >= t_max * det)
+                : (t >= 0 || t <= t_max * det))
+      return false;
+
+    t_max = t / det;
+    return true;
+  }
+
+  // The top-left rule of rasterizers, in the sheared plane: of the two
+  // triangles on either side of an edge, whose edge vectors are exact
+  // negations of each other, exactly one owns it.  The edge is
+  // (x0, y0) -> (x1, y1) and det gives the side the triangle faces.
+  static bool owns_edge(Real x0, Real y0, Real x1, Real y1, Real det) {
+    Real dx = x1 - x0, dy = y1 - y0;
+    if (det < 0) {
+      dx = -dx;
+      dy = -dy;
+    }
+    return dy > 0 || (dy == 0 && dx < 0);
+  }
+
+  static bool intersect_box(const Node& node, Point origin, Vec3 inv_dir,
+                            Real t_max) {
+    // Rounding can put the slab distances of a ray through a box's
+    // boundary, such as a vertex shared with a neighboring leaf, on the
+    // wrong side of each other; widening the exit by 2 gamma(3) keeps the
+    // test conservative (Ize, "Robust BVH Ray Traversal", JCGT 2013).
+    constexpr Real unit_roundoff = std::numeric_limits<Real>::epsilon() / 2;
+    constexpr Real gamma3 = 3 * unit_roundoff / (1 - 3 * unit_roundoff);
+    const Vec3 t0 = (node.lo - origin) * inv_dir;
+    const Vec3 t1 = (node.hi - origin) * inv_dir;
+    const Vec3 near = min(t0, t1), far = max(t0, t1);
+    const Real enter = std::max({near.x, near.y, near.z, Real(0)});
+    const Real exit =
+        std::min(std::min({far.x, far.y, far.z}) * (1 + 2 * gamma3), t_max);
+    return enter <= exit;
+  }
+
+  // Splits at the centroid median along the widest axis of the centroids.
+  void build_bvh() {
+    std::vector<uint32_t> order(triangles.size());
+    std::vector<Vec3> centroids(triangles.size());
+    for (uint32_t i = 0; i < triangles.size(); i++) {
+      order[i] = i;
+      centroids[i] = (vertices[triangles[i][0]] + vertices[triangles[i][1]] +
+                      vertices[triangles[i][2]]) /
+                     Real(3);
+    }
+    nodes.reserve(2 * triangles.size() / max_leaf_size + 1);
+    build_node(order, centroids, 0, order.size());
+
+    std::vector<std::array<uint32_t, 3>> sorted(triangles.size());
+    for (size_t i = 0; i < order.size(); i++) sorted[i] = triangles[order[i]];
+    triangles = std::move(sorted);
+  }
+
+  void build_node(std::vector<uint32_t>& order,
+                  const std::vector<Vec3>& centroids, uint32_t begin,
+                  uint32_t end) {
+    const uint32_t index = nodes.size();
+    nodes.push_back({});
+
+    Vec3 lo(std::numeric_limits<Real>::max());
+    Vec3 hi(std::numeric_limits<Real>::lowest());
+    Vec3 centroid_lo = lo, centroid_hi = hi;
+    for (uint32_t i = begin; i < end; i++) {
+      for (uint32_t vertex : triangles[order[i]]) {
+        lo = min(lo, vertices[vertex]);
+        hi = max(hi, vertices[vertex]);
+      }
+      centroid_lo = min(centroid_lo, centroids[order[i]]);
+      centroid_hi = max(centroid_hi, centroids[order[i]]);
+    }
+    nodes[index].lo = lo;
+    nodes[index].hi = hi;
+
+    const Vec3 extent = centroid_hi - centroid_lo;
+    const uint32_t axis =
+        extent.x > extent.y ? (extent.x > extent.z ? 0 : 2)
+                            : (extent.y > extent.z ? 1 : 2);
+    if (end - begin <= max_leaf_size || extent[axis] <= 0) {
+      nodes[index].first = begin;
+      nodes[index].count = end - begin;
+      return;
+    }
+
+    const uint32_t mid = begin + (end - begin) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + mid,
+                     order.begin() + end, [&](uint32_t a, uint32_t b) {
+                       return centroids[a][axis] < centroids[b][axis];
+                     });
+    build_node(order, centroids, begin, mid);
+    nodes[index].first = nodes.size();
+    nodes[index].count = 0;
+    nodes[index].axis = axis;
+    build_node(order, centroids, mid, end);
+  }
+
+  std::vector<Vec3> vertices;
+  std::vector<std::array<uint32_t, 3>> triangles;
+  std::vector<Node> nodes;
+};
+
+// A Mesh placed in the scene by a linear transform and translation.  Rays
+// are moved into mesh space instead of the mesh into world space, so any
+// number of instances share one copy of the geometry and BVH.
+class MeshInstance : public Object {
+ public:
+  MeshInstance(std::shared_ptr<const Mesh> mesh, Mat3 transform,
+               Vec3 translation, Material material)
+      : mesh(std::move(mesh)),
+        translation(translation),
+        inverse(glm::inverse(transform)),
+        normal_transform(transpose(inverse)),
+        material_(material) {}
+
+  std::optional<Hit> collide(Ray ray) override {
+    Real t = std::numeric_limits<Real>::infinity();
+    uint32_t triangle;
+    if (!mesh->intersect(to_mesh(ray), t, triangle, false))
+      return std::nullopt;
+
+    Hit hit;
+    hit.point = ray.at(t);
+    hit.normal = normalize(normal_transform * mesh->normal(triangle));
+    // Triangles are two-sided.
+    if (dot(hit.normal, ray.dir) > 0) hit.normal = -hit.normal;
+    hit.distance = distance(ray.origin, hit.point);
+    hit.primitive = triangle;
+    return hit;
+  }
+
+  bool occluded(Ray ray, Real max_distance) override {
+    Real t = max_distance / length(ray.dir);
+    uint32_t triangle;
+    return mesh->intersect(to_mesh(ray), t, triangle, true);
+  }
+
+  Material material(const Hit& hit) override { return material_; }
+
+ private:
+  // The direction is left unnormalized so t means the same in both spaces.
+  Ray to_mesh(Ray ray) const {
+    return {inverse * (ray.origin - translation), inverse * ray.dir};
+  }
+
+  std::shared_ptr<const Mesh> mesh;
+  Vec3 translation;
+  Mat3 inverse;
+  Mat3 normal_transform;
+  Material material_;
+};
@@ -0,0 +1,192 @@
+#include "gen/geometry.h"
+
+#include <random>
+
+#include "dvc/program.h"
+
+namespace {
+
+using Triangles = std::vector<std::array<uint32_t, 3>>;
+
+constexpr double tolerance = std::is_same_v<Real, float> ? 1e-4 : 1e-9;
+
+std::mt19937 rng(1);
+
+double uniform(double lo, double hi) {
+  return std::uniform_real_distribution<double>(lo, hi)(rng);
+}
+
+Vec3 uniform_point(double lo, double hi) {
+  return Vec3(uniform(lo, hi), uniform(lo, hi), uniform(lo, hi));
+}
+
+// n small triangles scattered over [-1, 1]^3.
+std::vector<Vec3> random_vertices(size_t n) {
+  std::vector<Vec3> vertices;
+  for (size_t i = 0; i < n; i++) {
+    const Vec3 center = uniform_point(-1, 1);
+    for (int j = 0; j < 3; j++)
+      vertices.push_back(center + uniform_point(-0.2, 0.2));
+  }
+  return vertices;
+}
+
+// Triangles of the vertices random_vertices(n) returns.
+Triangles separate_triangles(size_t n) {
+  Triangles triangles;
+  for (uint32_t i = 0; i < n; i++)
+    triangles.push_back({3 * i, 3 * i + 1, 3 * i + 2});
+  return triangles;
+}
+
+// A ray from outside [-1, 1]^3 towards a point inside it.
+Ray random_ray() {
+  const Vec3 origin = uniform_point(-3, 3);
+  return {origin, normalize(uniform_point(-1, 1) - origin)};
+}
+
+// Distance along ray to the nearest of triangles, by testing every one of
+// them in double.  Sets ambiguous if the ray passes so close to an edge
+// that a hit and a miss are both right.
+std::optional<double> brute_force(const std::vector<Vec3>& vertices,
+                                  const Triangles& triangles, Ray ray,
+                                  bool& ambiguous) {
+  const glm::dvec3 origin(ray.origin), dir(ray.dir);
+  std::optional<double> nearest;
+  ambiguous = false;
+  for (const std::array<uint32_t, 3>& tri : triangles) {
+    const glm::dvec3 a(vertices[tri[0]]), b(vertices[tri[1]]),
+        c(vertices[tri[2]]);
+    const glm::dvec3 p = cross(dir, c - a);
+    const double det = dot(b - a, p);
+    if (det == 0) continue;
+    const glm::dvec3 s = origin - a, q = cross(s, b - a);
+    const double u = dot(s, p) / det, v = dot(dir, q) / det, w = 1 - u - v;
+    const double t = dot(c - a, q) / det;
+    if (t <= 0) continue;
+    const double closest = std::min({u, v, w});
+    if (std::abs(closest) < 1e-4) ambiguous = true;
+    if (closest < 0) continue;
+    if (!nearest || t < *nearest) nearest = t;
+  }
+  return nearest;
+}
+
+bool hits(const Mesh& mesh, Ray ray) {
+  Real t = std::numeric_limits<Real>::infinity();
+  uint32_t triangle;
+  return mesh.intersect(ray, t, triangle, false);
+}
+
+}  // namespace
+
+int main() {
+  dvc::program program;
+
+  const Material material{};
+
+  // Closest hits and occlusion through the BVH match testing every
+  // triangle.
+  {
+    const std::vector<Vec3> vertices = random_vertices(500);
+    const Triangles triangles = separate_triangles(500);
+    auto mesh = std::make_shared<Mesh>(vertices, triangles);
+    MeshInstance instance(mesh, Mat3(1), Vec3(0), material);
+    size_t num_hits = 0;
+    for (int i = 0; i < 2000; i++) {
+      const Ray ray = random_ray();
+      bool ambiguous;
+      const std::optional<double> expected =
+          brute_force(vertices, triangles, ray, ambiguous);
+      if (ambiguous) continue;
+
+      Real t = std::numeric_limits<Real>::infinity();
+      uint32_t triangle;
+      DVC_ASSERT_EQ(mesh->intersect(ray, t, triangle, false),
+                    expected.has_value());
+      if (expected) {
+        num_hits++;
+        DVC_ASSERT_LT(std::abs(t - *expected), tolerance);
+      }
+
+      const Real max_distance = uniform(0, 6);
+      if (expected && std::abs(*expected - max_distance) < tolerance) continue;
+      const bool occluded = expected && *expected < max_distance;
+      t = max_distance;
+      DVC_ASSERT_EQ(mesh->intersect(ray, t, triangle, true), occluded);
+      DVC_ASSERT_EQ(instance.occluded(ray, max_distance), occluded);
+    }
+    DVC_ASSERT_GE(num_hits, 100);
+  }
+
+  // A ray through the edge two triangles share hits exactly one of them,
+  // and so does a ray through the vertex a fan of triangles shares.
+  {
+    const std::vector<Vec3> vertices = {
+        {0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}, {0.5, 0.5, 0}};
+    const Mesh lower(vertices, {{0, 1, 2}});
+    const Mesh upper(vertices, {{0, 2, 3}});
+    const std::vector<Mesh> fan = {
+        Mesh(vertices, {{0, 1, 4}}), Mesh(vertices, {{1, 2, 4}}),
+        Mesh(vertices, {{2, 3, 4}}), Mesh(vertices, {{3, 0, 4}})};
+    for (int i = 0; i < 10000; i++) {
+      const Vec3 origin(uniform(-2, 3), uniform(-2, 3), uniform(-3, 3));
+      if (origin.z == 0) continue;
+
+      const Real s = uniform(0.01, 0.99);
+      const Ray through_edge = {origin, normalize(Vec3(s, s, 0) - origin)};
+      DVC_ASSERT_EQ(hits(lower, through_edge) + hits(upper, through_edge), 1,
+                    through_edge.origin, " ", through_edge.dir);
+
+      const Ray through_vertex = {origin, normalize(vertices[4] - origin)};
+      int fan_hits = 0;
+      for (const Mesh& triangle : fan)
+        fan_hits += hits(triangle, through_vertex);
+      DVC_ASSERT_EQ(fan_hits, 1, through_vertex.origin, " ",
+                    through_vertex.dir);
+    }
+  }
+
+  // An instance hits where its transformed mesh does.
+  {
+    const std::vector<Vec3> vertices = random_vertices(200);
+    const Triangles triangles = separate_triangles(200);
+    Mat3 transform(2);
+    for (int column = 0; column < 3; column++)
+      transform[column] += uniform_point(-1, 1);
+    const Vec3 translation = uniform_point(-0.5, 0.5);
+    std::vector<Vec3> transformed;
+    for (Vec3 v : vertices) transformed.push_back(transform * v + translation);
+
+    MeshInstance instance(std::make_shared<Mesh>(vertices, triangles),
+                          transform, translation, material);
+    MeshInstance moved(std::make_shared<Mesh>(transformed, triangles),
+                       Mat3(1), Vec3(0), material);
+    size_t num_hits = 0;
+    for (int i = 0; i < 2000; i++) {
+      const Ray ray = random_ray();
+      bool ambiguous;
+      brute_force(transformed, triangles, ray, ambiguous);
+      if (ambiguous) continue;
+
+      const std::optional<Hit> hit = instance.collide(ray);
+      const std::optional<Hit> expected = moved.collide(ray);
+      DVC_ASSERT_EQ(hit.has_value(), expected.has_value());
+      if (expected) {
+        num_hits++;
+        DVC_ASSERT_LT(std::abs(hit->distance - expected->distance),
+                      100 * tolerance);
+        DVC_ASSERT_LT(distance(hit->point, expected->point), 100 * tolerance);
+        DVC_ASSERT_GT(dot(hit->normal, expected->normal), 1 - 100 * tolerance);
+      }
+
+      const Real max_distance = uniform(0, 12);
+      if (expected &&
+          std::abs(expected->distance - max_distance) < 100 * tolerance)
+        continue;
+      DVC_ASSERT_EQ(instance.occluded(ray, max_distance),
+                    moved.occluded(ray, max_distance));
+    }
+    DVC_ASSERT_GE(num_hits, 100);
+  }
+}
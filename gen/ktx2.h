@@ -0,0 +1,201 @@
+#pragma once
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "dvc/file.h"
+#include "dvc/log.h"
+
+// KTX 2.0 cube maps of VK_FORMAT_R8G8B8A8_UNORM texels, uncompressed or
+// with each level ZLIB supercompressed.
+//
+// FILE:
+//     Header
+//     LevelIndex[level_count]     level 0 (largest) first
+//     uint32(dfd_total_size)
+//     DESCRIPTOR_BLOCK            basic data format descriptor
+//     LEVEL_DATA[level_count]     smallest level first
+// LEVEL_DATA:
+//     texels of faces +X, -X, +Y, -Y, +Z, -Z, each row by row from the top
+//     left, possibly deflated.
+
+namespace ktx2 {
+
+constexpr uint8_t identifier[12] = {0xAB, 'K',  'T',  'X',  ' ',  '2',
+                                    '0',  0xBB, '\r', '\n', 0x1A, '\n'};
+
+constexpr uint32_t vk_format_r8g8b8a8_unorm = 37;
+
+constexpr uint32_t supercompression_none = 0;
+constexpr uint32_t supercompression_zlib = 3;
+
+struct Header {
+  uint8_t identifier[12];
+  uint32_t vk_format;
+  uint32_t type_size;
+  uint32_t pixel_width;
+  uint32_t pixel_height;
+  uint32_t pixel_depth;
+  uint32_t layer_count;
+  uint32_t face_count;
+  uint32_t level_count;
+  uint32_t supercompression_scheme;
+  uint32_t dfd_byte_offset;
+  uint32_t dfd_byte_length;
+  uint32_t kvd_byte_offset;
+  uint32_t kvd_byte_length;
+  uint64_t sgd_byte_offset;
+  uint64_t sgd_byte_length;
+};
+static_assert(sizeof(Header) == 80);
+
+struct LevelIndex {
+  uint64_t byte_offset;
+  uint64_t byte_length;
+  uint64_t uncompressed_byte_length;
+};
+
+// Basic data format descriptor for 8-bit linear RGBA.  bytesPlane0 is zero
+// for supercompressed files.
+inline std::vector<uint32_t> rgba8_descriptor(bool supercompressed) {
+  std::vector<uint32_t> dfd = {
+      4 + 24 + 4 * 16,                  // dfdTotalSize
+      0,                                // vendorId, descriptorType
+      2 | (24 + 4 * 16) << 16,          // versionNumber, descriptorBlockSize
+      1 | 1 << 8 | 1 << 16,             // RGBSDA, BT709, linear, straight
+      0,                                // 1x1x1x1 texel blocks
+      supercompressed ? 0u : 4u,        // bytesPlane0..3
+      0,                                // bytesPlane4..7
+  };
+  const uint32_t channels[4] = {0, 1, 2, 15};  // R, G, B, A
+  for (uint32_t i = 0; i < 4; i++) {
+    dfd.push_back(8 * i | 7 << 16 | channels[i] << 24);
+    dfd.push_back(0);    // samplePosition
+    dfd.push_back(0);    // sampleLower
+    dfd.push_back(255);  // sampleUpper
+  }
+  return dfd;
+}
+
+// Writes a cube map whose levels[l] holds the six faces of level l, each
+// (width >> l) texels square.
+inline void save_cube(const std::filesystem::path& path, uint32_t width,
+                      const std::vector<std::string>& levels, bool deflate) {
+  const std::vector<uint32_t> dfd = rgba8_descriptor(deflate);
+
+  Header header = {};
+  std::memcpy(header.identifier, identifier, sizeof(identifier));
+  header.vk_format = vk_format_r8g8b8a8_unorm;
+  header.type_size = 1;
+  header.pixel_width = width;
+  header.pixel_height = width;
+  header.face_count = 6;
+  header.level_count = levels.size();
+  header.supercompression_scheme =
+      deflate ? supercompression_zlib : supercompression_none;
+  header.dfd_byte_offset = sizeof(Header) + levels.size() * sizeof(LevelIndex);
+  header.dfd_byte_length = dfd.size() * sizeof(uint32_t);
+
+  std::vector<LevelIndex> index(levels.size());
+  std::vector<std::string> data(levels.size());
+  uint64_t offset = header.dfd_byte_offset + header.dfd_byte_length;
+  for (size_t level = levels.size(); level-- > 0;) {
+    const std::string& texels = levels[level];
+    const uint32_t level_width = std::max(1u, width >> level);
+    DVC_ASSERT_EQ(texels.size(), size_t(6) * level_width * level_width * 4);
+    if (deflate) {
+      uLongf length = compressBound(texels.size());
+      data[level].resize(length);
+      DVC_ASSERT_EQ(compress2((Bytef*)data[level].data(), &length,
+                              (const Bytef*)texels.data(), texels.size(),
+                              Z_BEST_COMPRESSION),
+                    Z_OK);
+      data[level].resize(length);
+    } else {
+      data[level] = texels;
+    }
+    index[level] = {offset, data[level].size(), texels.size()};
+    offset += data[level].size();
+  }
+
+  std::string file;
+  file.append((const char*)&header, sizeof(header));
+  file.append((const char*)index.data(), index.size() * sizeof(LevelIndex));
+  file.append((const char*)dfd.data(), dfd.size() * sizeof(uint32_t));
+  for (size_t level = levels.size(); level-- > 0;) file += data[level];
+  dvc::save_file(path, file);
+}
+
+class CubeReader {
+ public:
+  CubeReader(const std::filesystem::path& path) : file(dvc::load_file(path)) {
+    if (file.size() < sizeof(Header) ||
+        std::memcmp(file.data(), identifier, sizeof(identifier)) != 0)
+      DVC_FAIL("Not a KTX2 file: ", path);
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (header.vk_format != vk_format_r8g8b8a8_unorm ||
+        header.face_count != 6 || header.layer_count > 1 ||
+        header.pixel_depth > 0 || header.pixel_width != header.pixel_height)
+      DVC_FAIL("Not an RGBA8 cube map: ", path);
+    if (header.supercompression_scheme != supercompression_none &&
+        header.supercompression_scheme != supercompression_zlib)
+      DVC_FAIL("Unsupported KTX2 supercompression ",
+               header.supercompression_scheme, ": ", path);
+
+    const uint32_t num_levels = std::max(1u, header.level_count);
+    if (file.size() < sizeof(Header) + num_levels * sizeof(LevelIndex))
+      DVC_FAIL("Truncated KTX2 file: ", path);
+    index.resize(num_levels);
+    std::memcpy(index.data(), file.data() + sizeof(Header),
+                num_levels * sizeof(LevelIndex));
+    for (uint32_t level = 0; level < num_levels; level++) {
+      const LevelIndex& entry = index[level];
+      if (entry.byte_offset > file.size() ||
+          entry.byte_length > file.size() - entry.byte_offset ||
+          entry.uncompressed_byte_length != level_size(level) ||
+          (header.supercompression_scheme == supercompression_none &&
+           entry.byte_length != level_size(level)))
+        DVC_FAIL("Corrupt KTX2 level ", level, ": ", path);
+    }
+  }
+
+  uint32_t width() const { return header.pixel_width; }
+  uint32_t num_levels() const { return index.size(); }
+
+  uint32_t level_width(uint32_t level) const {
+    return std::max(1u, width() >> level);
+  }
+
+  // Bytes of texel data in all six faces of level.
+  uint64_t level_size(uint32_t level) const {
+    return uint64_t(6) * level_width(level) * level_width(level) * 4;
+  }
+
+  // Writes level_size(level) bytes of texels to out.
+  void read_level(uint32_t level, void* out) const {
+    const LevelIndex& entry = index.at(level);
+    const char* data = file.data() + entry.byte_offset;
+    if (header.supercompression_scheme == supercompression_none) {
+      std::memcpy(out, data, level_size(level));
+      return;
+    }
+    uLongf length = entry.uncompressed_byte_length;
+    if (uncompress((Bytef*)out, &length, (const Bytef*)data,
+                   entry.byte_length) != Z_OK ||
+        length != entry.uncompressed_byte_length)
+      DVC_FAIL("Corrupt KTX2 level ", level);
+  }
+
+ private:
+  std::string file;
+  Header header;
+  std::vector<LevelIndex> index;
+};
+
+}  // namespace ktx2
@@ -0,0 +1,95 @@
+#include "gen/ktx2.h"
+
+#include "dvc/program.h"
+#include "gen/cube_map.h"
+
+int main() {
+  dvc::program program;
+  std::filesystem::path test_tmpdir = std::getenv("TEST_TMPDIR");
+
+  // Texels that differ by face, level position and channel.
+  CubeMap cube(4, 1);
+  cube.shade_texels([](size_t face, size_t x, size_t y) {
+    return glm::vec3(face / 5.0f, x / 3.0f, y / 3.0f);
+  });
+  DVC_ASSERT_EQ(cube.levels.size(), 3);
+
+  for (bool deflate : {false, true}) {
+    const std::filesystem::path path =
+        test_tmpdir / (deflate ? "deflated.ktx2" : "plain.ktx2");
+    if (deflate)
+      cube.write_ktx2(path);
+    else
+      ktx2::save_cube(path, cube.width, cube.levels, false);
+    const std::string file = dvc::load_file(path);
+
+    ktx2::Header header;
+    DVC_ASSERT_GE(file.size(), sizeof(header));
+    std::memcpy(&header, file.data(), sizeof(header));
+    DVC_ASSERT(std::memcmp(header.identifier, ktx2::identifier,
+                           sizeof(ktx2::identifier)) == 0);
+    DVC_ASSERT_EQ(header.vk_format, ktx2::vk_format_r8g8b8a8_unorm);
+    DVC_ASSERT_EQ(header.type_size, 1);
+    DVC_ASSERT_EQ(header.pixel_width, 4);
+    DVC_ASSERT_EQ(header.pixel_height, 4);
+    DVC_ASSERT_EQ(header.pixel_depth, 0);
+    DVC_ASSERT_EQ(header.layer_count, 0);
+    DVC_ASSERT_EQ(header.face_count, 6);
+    DVC_ASSERT_EQ(header.level_count, 3);
+    DVC_ASSERT_EQ(header.supercompression_scheme,
+                  deflate ? ktx2::supercompression_zlib
+                          : ktx2::supercompression_none);
+    DVC_ASSERT_EQ(header.kvd_byte_length, 0);
+    DVC_ASSERT_EQ(header.sgd_byte_length, 0);
+
+    // The descriptor follows the level index, and its bytesPlane0 is zero
+    // only when the levels are supercompressed.
+    std::vector<ktx2::LevelIndex> index(header.level_count);
+    std::memcpy(index.data(), file.data() + sizeof(header),
+                index.size() * sizeof(ktx2::LevelIndex));
+    DVC_ASSERT_EQ(header.dfd_byte_offset,
+                  sizeof(header) + index.size() * sizeof(ktx2::LevelIndex));
+    std::vector<uint32_t> dfd(header.dfd_byte_length / sizeof(uint32_t));
+    DVC_ASSERT_EQ(dfd.size() * sizeof(uint32_t), header.dfd_byte_length);
+    std::memcpy(dfd.data(), file.data() + header.dfd_byte_offset,
+                header.dfd_byte_length);
+    DVC_ASSERT(dfd == ktx2::rgba8_descriptor(deflate));
+    DVC_ASSERT_EQ(dfd[0], header.dfd_byte_length);
+    DVC_ASSERT_EQ(dfd[5] & 0xff, deflate ? 0 : 4);
+
+    // Levels are stored smallest first, back to back up to the end of the
+    // file, and each unpacks to the cube's texels.
+    uint64_t offset = header.dfd_byte_offset + header.dfd_byte_length;
+    for (size_t level = index.size(); level-- > 0;) {
+      const ktx2::LevelIndex& entry = index[level];
+      DVC_ASSERT_EQ(entry.byte_offset, offset);
+      offset += entry.byte_length;
+      DVC_ASSERT_EQ(entry.uncompressed_byte_length, cube.levels[level].size());
+
+      std::string texels(entry.uncompressed_byte_length, 0);
+      if (deflate) {
+        uLongf length = texels.size();
+        DVC_ASSERT_EQ(uncompress((Bytef*)texels.data(), &length,
+                                 (const Bytef*)file.data() + entry.byte_offset,
+                                 entry.byte_length),
+                      Z_OK);
+        DVC_ASSERT_EQ(length, texels.size());
+      } else {
+        DVC_ASSERT_EQ(entry.byte_length, texels.size());
+        texels = file.substr(entry.byte_offset, entry.byte_length);
+      }
+      DVC_ASSERT(texels == cube.levels[level]);
+    }
+    DVC_ASSERT_EQ(offset, file.size());
+
+    // CubeReader reads the same texels back.
+    ktx2::CubeReader reader(path);
+    DVC_ASSERT_EQ(reader.width(), 4);
+    DVC_ASSERT_EQ(reader.num_levels(), 3);
+    for (uint32_t level = 0; level < reader.num_levels(); level++) {
+      std::string texels(reader.level_size(level), 0);
+      reader.read_level(level, texels.data());
+      DVC_ASSERT(texels == cube.levels[level]);
+    }
+  }
+}
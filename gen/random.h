@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <type_traits>
+
+// Philox4x32-10 counter-based random numbers (Salmon et al., "Parallel
+// random numbers: as easy as 1, 2, 3").  Each block of four words is a pure
+// function of (key, counter), so any piece of work that derives its stream
+// from its own index gets the same numbers whichever thread runs it.
+
+using PhiloxBlock = std::array<uint32_t, 4>;
+
+inline PhiloxBlock philox4x32(PhiloxBlock counter,
+                              std::array<uint32_t, 2> key) {
+  for (int round = 0; round < 10; round++) {
+    if (round > 0) {
+      key[0] += 0x9E3779B9;
+      key[1] += 0xBB67AE85;
+    }
+    const uint64_t product0 = uint64_t(0xD2511F53) * counter[0];
+    const uint64_t product1 = uint64_t(0xCD9E8D57) * counter[2];
+    counter = {uint32_t(product1 >> 32) ^ counter[1] ^ key[0],
+               uint32_t(product1),
+               uint32_t(product0 >> 32) ^ counter[3] ^ key[1],
+               uint32_t(product0)};
+  }
+  return counter;
+}
+
+// The sequence of numbers numbered stream under seed.  Streams of one seed
+// are independent, so callers key them by what they are generating (a
+// star, a pixel sample) rather than by thread.
+class Random {
+ public:
+  Random(uint64_t seed, uint64_t stream)
+      : key{uint32_t(seed), uint32_t(seed >> 32)},
+        counter{0, 0, uint32_t(stream), uint32_t(stream >> 32)} {}
+
+  uint32_t next() {
+    if (used == 4) {
+      block = philox4x32(counter, key);
+      if (++counter[0] == 0) counter[1]++;
+      used = 0;
+    }
+    return block[used++];
+  }
+
+  // Uniform in [0, 1).
+  template <typename T = float>
+  T unit() {
+    static_assert(std::is_floating_point_v<T>);
+    if constexpr (sizeof(T) <= sizeof(float)) {
+      return T((next() >> 8) * 0x1p-24f);
+    } else {
+      // Sequenced, so that the first word is the high half on any compiler.
+      const uint64_t hi = next();
+      const uint64_t lo = next();
+      const uint64_t bits = hi << 32 | lo;
+      return T((bits >> 11) * 0x1p-53);
+    }
+  }
+
+  // Uniform in [-1, 1).
+  template <typename T = float>
+  T signed_unit() {
+    return 2 * unit<T>() - 1;
+  }
+
+ private:
+  std::array<uint32_t, 2> key;
+  PhiloxBlock counter;
+  PhiloxBlock block;
+  uint32_t used = 4;
+};
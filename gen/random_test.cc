@@ -0,0 +1,42 @@
+#include "gen/random.h"
+#include "dvc/program.h"
+
+int main() {
+  dvc::program program;
+
+  // Known answers from the Random123 distribution.
+  DVC_ASSERT(philox4x32({0, 0, 0, 0}, {0, 0}) ==
+             PhiloxBlock({0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}));
+  DVC_ASSERT(philox4x32({0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+                        {0xffffffff, 0xffffffff}) ==
+             PhiloxBlock({0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}));
+  DVC_ASSERT(philox4x32({0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344},
+                        {0xa4093822, 0x299f31d0}) ==
+             PhiloxBlock({0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}));
+
+  // A stream replays exactly and does not depend on other streams.
+  Random a(42, 7), b(42, 7), c(42, 8), d(43, 7);
+  bool differs_by_stream = false, differs_by_seed = false;
+  for (int i = 0; i < 100; i++) {
+    const uint32_t x = a.next();
+    DVC_ASSERT_EQ(x, b.next());
+    differs_by_stream |= x != c.next();
+    differs_by_seed |= x != d.next();
+  }
+  DVC_ASSERT(differs_by_stream);
+  DVC_ASSERT(differs_by_seed);
+
+  // unit<double> takes the high half of its bits from the first word of the
+  // block above, seed 0 and stream 0 being its key and counter.
+  Random zero(0, 0);
+  DVC_ASSERT_EQ(zero.unit<double>(), (0x6627e8d5e169c58d >> 11) * 0x1p-53);
+  DVC_ASSERT_EQ(zero.unit<double>(), (0xbc57ac4c9b00dbd8 >> 11) * 0x1p-53);
+
+  Random e(1, 2);
+  for (int i = 0; i < 1000; i++) {
+    const float f = e.unit();
+    DVC_ASSERT(f >= 0 && f < 1);
+    const double g = e.signed_unit<double>();
+    DVC_ASSERT(g >= -1 && g < 1);
+  }
+}
@@ -1,6 +1,24 @@
-hello()
+import array
+import random
 
-sphere(
-    pos=[0,0,0],
-    radius=1,
-)
+camera(eye=[0, 0, 0], lookat=[0, 0, 1], fov=90)
+
+light(pos=[1, 100, -100])
+
+red = material(color=[1, 0, 0], reflectance=0.25)
+mirror = material(diffuse=0.1, specular=0.5, reflectance=0.8)
+
+sphere(pos=[0, 0, 30], radius=5, material=mirror)
+
+# Bulk geometry: any float64 buffer works, e.g. numpy arrays of shape (n, 3)
+# and (n,).  Seeded, so that every run renders the same scene.
+random.seed(0)
+n = 100
+centers = array.array('d')
+radii = array.array('d')
+for i in range(n):
+    centers.extend([random.randint(-10, 10), random.randint(-10, 10),
+                    random.randint(-10, 10) + 30])
+    radii.append(random.randint(1, 10))
+
+spheres(centers, radii, material=red)
@@ -1,63 +1,54 @@
 #include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <filesystem>
 #include <glm/glm.hpp>
+#include <map>
+#include <memory>
 #include <optional>
 #include <png++/png.hpp>
-#include <random>
+#include <png.h>
+#include <sstream>
+#include <type_traits>
 
 #include "dvc/file.h"
 #include "dvc/opts.h"
 #include "dvc/program.h"
 #include "dvc/python.h"
+#include "gen/geometry.h"
+#include "gen/random.h"
 
 uint32_t DVC_OPTION(height, -, dvc::required, "image height");
 uint32_t DVC_OPTION(width, -, dvc::required, "image width");
 uint32_t DVC_OPTION(antialias, -, 1, "antialias samples");
-std::string DVC_OPTION(output, o, dvc::required, "output image");
-
-using glm::dvec2;
-using glm::dvec3;
-
-const dvec3 eye = {0, 0, 0};
-
-const dvec3 topleft = {-1, 1, 1};
-const dvec3 topright = {1, 1, 1};
-const dvec3 botleft = {-1, -1, 1};
-const dvec3 botright = {1, -1, 1};
-
-const dvec3 center = topleft + 0.5 * (botright - topleft);
-const dvec3 dir_right = (botright + topright) / 2.0 - center;
-const dvec3 dir_up = (topleft + topright) / 2.0 - center;
-
-namespace glm {
-template <length_t L, typename T, qualifier Q>
-std::ostream& operator<<(std::ostream& o, vec<L, T, Q> v) {
-  o << "[ ";
-  for (length_t i = 0; i < L; i++) o << v[i] << " ";
-  o << "]";
-
-  return o;
-}
-}  // namespace glm
-
-using Color = dvec3;
-using Direction = dvec3;
-using Point = dvec3;
-
-struct Material {
-  double specular;
-  double diffuse;
-  double ambient;
-  double shininess;
-  Color color;
-};
-
-struct Ray {
-  Point origin;
-  Direction dir;
-
-  Point at(double t) const { return origin + t * dir; }
-};
+bool DVC_OPTION(shadows, -, true, "cast shadow rays");
+uint32_t DVC_OPTION(max_depth, -, 4, "max reflection depth");
+uint32_t DVC_OPTION(roulette_depth, -, 2,
+                    "reflection depth at which russian roulette starts");
+uint64_t DVC_OPTION(seed, -, 0, "random seed for russian roulette");
+bool DVC_OPTION(adaptive, -, false,
+                "antialias only pixels that contrast with a neighbor");
+double DVC_OPTION(adaptive_threshold, -, 0.05,
+                  "per-channel contrast that triggers adaptive antialiasing");
+bool DVC_OPTION(progressive, -, false,
+                "write output.passN.png after each sampling pass");
+std::string DVC_OPTION(reference, -, "",
+                       "image to diff the output against, e.g. a render "
+                       "made by the double precision tracer");
+uint32_t DVC_OPTION(diff_tolerance, -, 255,
+                    "fail if any output channel differs from --reference "
+                    "by more than this");
+uint32_t DVC_OPTION(tile_rows, -, 16, "rows rendered and written at a time");
+uint32_t DVC_OPTION(tile_cols, -, 16, "tile width for --stats_json/--heatmap");
+std::string DVC_OPTION(stats_json, -, "",
+                       "write render statistics as JSON to this file");
+std::string DVC_OPTION(heatmap, -, "",
+                       "write per-tile render time as a PNG, one pixel per "
+                       "tile");
+std::string DVC_OPTION(output, o, dvc::required,
+                       "output image, .png or .pfm (float HDR)");
 
 struct Light {
   Point source;
@@ -65,182 +56,816 @@ struct Light {
   Color diffuse;
 };
 
-dvec3 ambient = {1, 1, 1};
-
-std::vector<Light> lights;
-
-struct Hit {
-  Point point;
-  Direction normal;
-};
-
-class Object {
- public:
-  virtual std::optional<Hit> collide(Ray ray) = 0;
-  virtual Material material(Point point) = 0;
+// The image plane spans [-1, 1] in both axes at unit distance scaled by
+// tan(fov / 2).  The default looks down +z from the origin with fov 90.
+struct Camera {
+  Point eye = {0, 0, 0};
+  Point lookat = {0, 0, 1};
+  Direction up = {0, 1, 0};
+  Real fov = 90;
+
+  Ray ray(Vec2 pos) const {
+    const Direction forward = normalize(lookat - eye);
+    const Direction right = normalize(cross(up, forward));
+    const Direction true_up = cross(forward, right);
+    const Real scale = std::tan(glm::radians(fov) / 2);
+    return {eye, normalize(forward + scale * (pos.x * right + pos.y * true_up))};
+  }
 };
 
 struct ObjectHit {
   Hit hit;
   Object* object = nullptr;
-  Material material() { return object->material(hit.point); }
+  Material material() { return object->material(hit); }
 };
 
 struct Scene {
-  Color ambient;
+  Color ambient = {1, 1, 1};
+  Camera camera;
   std::vector<Light> lights;
+  std::vector<Material> materials = {{0.33, 0.33, 0.33, 100, {1, 1, 1}}};
   std::vector<Object*> objects;
 
   std::optional<ObjectHit> collide(Ray ray) const {
+    ScopedTimer timer(collect_timing ? &stats().intersection_time : nullptr);
     ObjectHit nearest_hit;
     for (Object* object : objects) {
       if (std::optional<Hit> candidate_hit = object->collide(ray)) {
         if (nearest_hit.object == nullptr ||
-            distance(ray.origin, candidate_hit->point) <
-                distance(ray.origin, nearest_hit.hit.point)) {
+            candidate_hit->distance < nearest_hit.hit.distance) {
           nearest_hit.object = object;
           nearest_hit.hit = *candidate_hit;
         }
       }
     }
-    if (nearest_hit.object == nullptr)
-      return std::nullopt;
-    else
-      return nearest_hit;
+    if (nearest_hit.object == nullptr) return std::nullopt;
+    stats().hits++;
+    return nearest_hit;
+  }
+
+  // Any-hit query: stops at the first object closer than max_distance.
+  bool occluded(Ray ray, Real max_distance) const {
+    ScopedTimer timer(collect_timing ? &stats().intersection_time : nullptr);
+    for (Object* object : objects)
+      if (object->occluded(ray, max_distance)) return true;
+    return false;
   }
 };
 
-class Sphere : public Object {
+// Offset applied along the normal to secondary ray origins so they don't
+// re-hit the surface they leave from.
+constexpr Real surface_epsilon = std::is_same_v<Real, float> ? 1e-3 : 1e-9;
+
+Color trace(const Scene& scene, Ray ray, uint32_t depth, Real weight,
+            Random& random);
+
+// weight is the product of reflectances along the path so far; it drives
+// russian roulette so that dim deep bounces are usually not traced at all.
+Color shade(const Scene& scene, Ray ray, ObjectHit hit, uint32_t depth,
+            Real weight, Random& random) {
+  Material material = hit.material();
+  Color color = scene.ambient * material.ambient * material.color;
+  const Vec3 N = hit.hit.normal;
+  const Point origin = hit.hit.point + surface_epsilon * N;
+  for (const Light& light : scene.lights) {
+    Vec3 L = normalize(light.source - hit.hit.point);
+    Real D = dot(L, N);
+    if (D <= 0) continue;
+    if (shadows) {
+      stats().shadow_rays++;
+      if (scene.occluded({origin, L}, distance(origin, light.source))) {
+        stats().shadow_occluded++;
+        continue;
+      }
+    }
+    Vec3 R = Real(2) * D * N - L;
+    Vec3 V = normalize(ray.origin - hit.hit.point);
+    color += material.diffuse * D * light.diffuse * material.color;
+    Real S = dot(R, V);
+    if (S <= 0) continue;
+    color +=
+        material.specular * std::pow(S, material.shininess) * light.specular;
+  }
+
+  if (material.reflectance <= 0 || depth >= max_depth) return color;
+
+  Real reflected_weight = weight * material.reflectance;
+  Real survival = 1;
+  if (depth >= roulette_depth) {
+    survival = std::min(reflected_weight, Real(1));
+    if (random.unit<Real>() >= survival) {
+      stats().roulette_terminated++;
+      return color;
+    }
+  }
+
+  stats().reflection_rays++;
+  Ray reflected = {origin, reflect(ray.dir, N)};
+  color += material.reflectance / survival *
+           trace(scene, reflected, depth + 1, reflected_weight, random);
+  return color;
+}
+
+Color trace(const Scene& scene, Ray ray, uint32_t depth, Real weight,
+            Random& random) {
+  std::optional<ObjectHit> hit = scene.collide(ray);
+
+  if (!hit) return {0, 0, 0};
+
+  return shade(scene, ray, *hit, depth, weight, random);
+}
+
+Vec3 render_pos(const Scene& scene, Vec2 pos, Random& random) {
+  stats().camera_rays++;
+  return trace(scene, scene.camera.ray(pos), 0, 1, random);
+}
+
+uint32_t num_tile_rows() { return (height + tile_rows - 1) / tile_rows; }
+uint32_t num_tile_cols() { return (width + tile_cols - 1) / tile_cols; }
+
+// The calling thread's time counter for the tile containing the pixel.
+std::chrono::nanoseconds& pixel_time(uint32_t row, uint32_t col) {
+  std::vector<std::chrono::nanoseconds>& tile_time = stats().tile_time;
+  if (tile_time.empty()) tile_time.resize(num_tile_rows() * num_tile_cols());
+  return tile_time[row / tile_rows * num_tile_cols() + col / tile_cols];
+}
+
+// Averages a samples x samples grid of rays over the pixel.  Each ray draws
+// from its own stream, keyed by pixel and sample, so an image depends only
+// on --seed.
+Color render_pixel(const Scene& scene, uint32_t row, uint32_t col,
+                   uint32_t samples) {
+  ScopedTimer timer(collect_timing ? &pixel_time(row, col) : nullptr);
+  Real dx = 1.0 / width / samples;
+  Real dy = 1.0 / height / samples;
+  Real x = 2.0 * col / width - 1.0;
+  Real y = 1.0 - 2.0 * row / height;
+
+  Color color(0, 0, 0);
+  for (uint32_t arow = 0; arow < samples; arow++)
+    for (uint32_t acol = 0; acol < samples; acol++) {
+      Vec2 pos(x + (1 + 2 * acol) * dx, y - (1 + 2 * arow) * dy);
+      Random random(seed, (uint64_t(row) * width + col) << 32 |
+                              (arow * samples + acol));
+
+      color += render_pos(scene, pos, random);
+    }
+
+  return color / Real(samples * samples);
+}
+
+// Receives the image a band of rows at a time, so only the bands in flight
+// are ever held in memory.  Bands may arrive in any order.
+class ImageWriter {
  public:
-  Sphere(dvec3 center, double radius, Material material)
-      : center(center), radius(radius), material_(material) {}
+  virtual ~ImageWriter() = default;
+  virtual void write_rows(uint32_t first_row, uint32_t num_rows,
+                          const Color* pixels) = 0;
+};
 
-  std::optional<Hit> collide(Ray ray) override {
-    std::optional<dvec3> point = intersect_point(ray);
+// 8-bit RGBA PNG written row by row through libpng.  PNG rows must be
+// emitted in order, so bands that arrive early are held until the rows
+// before them have been written.
+class PngWriter : public ImageWriter {
+ public:
+  PngWriter(const std::filesystem::path& path) : path(path) {
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) DVC_FAIL("Unable to open ", path, ": ", std::strerror(errno));
+    png = png_create_write_struct(PNG_LIBPNG_VER_STRING, this, error, warning);
+    info = png_create_info_struct(png);
+    png_init_io(png, file);
+    png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGBA,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                 PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+  }
 
-    if (!point) return std::nullopt;
+  void write_rows(uint32_t first_row, uint32_t num_rows,
+                  const Color* pixels) override {
+    std::vector<png_byte>& band = pending[first_row];
+    band.resize(size_t(num_rows) * width * 4);
+    for (size_t i = 0; i < size_t(num_rows) * width; i++) {
+      band[4 * i + 0] = 255 * std::clamp(pixels[i].r, Real(0), Real(1));
+      band[4 * i + 1] = 255 * std::clamp(pixels[i].g, Real(0), Real(1));
+      band[4 * i + 2] = 255 * std::clamp(pixels[i].b, Real(0), Real(1));
+      band[4 * i + 3] = 255;
+    }
 
-    Hit hit;
-    hit.point = *point;
-    hit.normal = normalize(hit.point - center);
-    return hit;
+    while (!pending.empty() && pending.begin()->first == next_row) {
+      std::vector<png_byte>& rows = pending.begin()->second;
+      for (size_t offset = 0; offset < rows.size(); offset += width * 4) {
+        png_write_row(png, rows.data() + offset);
+        next_row++;
+      }
+      pending.erase(pending.begin());
+    }
   }
 
-  Material material(Point point) override { return material_; }
+  ~PngWriter() {
+    DVC_ASSERT_EQ(next_row, height, "incomplete image ", path);
+    png_write_end(png, nullptr);
+    png_destroy_write_struct(&png, &info);
+    std::fclose(file);
+  }
 
  private:
-  std::optional<dvec3> intersect_point(Ray ray) {
-    const double a = dot(ray.dir, ray.dir);
-    const double b = dot(2.0 * ray.dir, ray.origin - center);
-    const double c =
-        dot(ray.origin - center, ray.origin - center) - radius * radius;
+  static void error(png_structp png, png_const_charp message) {
+    DVC_FATAL("libpng error writing ",
+              ((PngWriter*)png_get_error_ptr(png))->path, ": ", message);
+  }
 
-    if (b * b < 4 * a * c) return std::nullopt;
+  static void warning(png_structp png, png_const_charp message) {
+    DVC_LOG("libpng warning writing ",
+            ((PngWriter*)png_get_error_ptr(png))->path, ": ", message);
+  }
 
-    const double d = std::sqrt(b * b - 4 * a * c);
+  std::filesystem::path path;
+  std::FILE* file;
+  png_structp png;
+  png_infop info;
+  uint32_t next_row = 0;
+  std::map<uint32_t, std::vector<png_byte>> pending;
+};
 
-    const double t1 = (-b + d) / (2 * a);
-    const double t2 = (-b - d) / (2 * a);
+// Little-endian RGB float PFM, keeping the unclamped HDR values.  The
+// header has a fixed size, so each band is written straight to its place
+// in the file (PFM stores rows bottom to top) in whatever order it comes.
+class PfmWriter : public ImageWriter {
+ public:
+  PfmWriter(const std::filesystem::path& path) : path(path) {
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) DVC_FAIL("Unable to open ", path, ": ", std::strerror(errno));
+    const std::string header = dvc::concat("PF\n", width, " ", height, "\n-1\n");
+    write(header.data(), header.size());
+    header_size = header.size();
+  }
 
-    if (t1 < 0) {
-      if (t2 < 0) {
-        return std::nullopt;
-      } else {
-        return ray.at(t2);
-      }
-    } else {
-      if (t2 < 0) {
-        return ray.at(t1);
-      } else {
-        const dvec3 p1 = ray.at(t1);
-        const dvec3 p2 = ray.at(t2);
-        if (distance(ray.origin, p1) < distance(ray.origin, p2))
-          return p1;
-        else
-          return p2;
-      }
+  void write_rows(uint32_t first_row, uint32_t num_rows,
+                  const Color* pixels) override {
+    std::vector<float> row(size_t(width) * 3);
+    for (uint32_t i = 0; i < num_rows; i++) {
+      for (uint32_t col = 0; col < width; col++)
+        for (int c = 0; c < 3; c++) row[3 * col + c] = pixels[i * width + col][c];
+      const uint32_t file_row = height - 1 - (first_row + i);
+      if (std::fseek(file, header_size + long(file_row) * width * 12,
+                     SEEK_SET) != 0)
+        DVC_FAIL("Unable to seek in ", path, ": ", std::strerror(errno));
+      write(row.data(), row.size() * sizeof(float));
     }
   }
 
-  dvec3 center;
-  double radius;
-  Material material_;
+  ~PfmWriter() { std::fclose(file); }
+
+ private:
+  void write(const void* data, size_t size) {
+    if (std::fwrite(data, 1, size, file) != size)
+      DVC_FAIL("Unable to write ", path, ": ", std::strerror(errno));
+  }
+
+  std::filesystem::path path;
+  std::FILE* file;
+  size_t header_size;
 };
 
-dvec3 shade(const Scene& scene, Ray ray, ObjectHit hit) {
-  Material material = hit.material();
-  Color color = scene.ambient * material.ambient;
-  for (const Light& light : scene.lights) {
-    dvec3 N = hit.hit.normal;
-    dvec3 L = normalize(light.source - hit.hit.point);
-    dvec3 R = 2.0 * dot(L, N) * N - L;
-    dvec3 V = normalize(ray.origin - hit.hit.point);
-    double D = dot(L, N);
-    if (D <= 0) continue;
-    color += material.diffuse * D * light.diffuse;
-    double S = dot(R, V);
-    if (S <= 0) continue;
-    color +=
-        material.specular * std::pow(S, material.shininess) * light.specular;
+std::unique_ptr<ImageWriter> open_image(const std::filesystem::path& path) {
+  if (path.extension() == ".pfm") return std::make_unique<PfmWriter>(path);
+  return std::make_unique<PngWriter>(path);
+}
+
+void write_image(const std::vector<Color>& pixels,
+                 const std::filesystem::path& path) {
+  open_image(path)->write_rows(0, height, pixels.data());
+}
+
+// Logs how far the output is from --reference and fails past
+// --diff_tolerance.
+void diff_reference() {
+  if (std::filesystem::path(output).extension() == ".pfm")
+    DVC_FAIL("--reference needs a PNG --output");
+  png::image<png::rgba_pixel> expected(reference);
+  png::image<png::rgba_pixel> actual(output);
+  if (expected.get_width() != width || expected.get_height() != height)
+    DVC_FAIL("Reference ", reference, " is ", expected.get_width(), "x",
+             expected.get_height(), ", expected ", width, "x", height);
+
+  uint32_t max_diff = 0;
+  uint64_t total_diff = 0;
+  for (uint32_t row = 0; row < height; row++)
+    for (uint32_t col = 0; col < width; col++) {
+      png::rgba_pixel a = actual[row][col], e = expected[row][col];
+      for (uint32_t diff : {std::abs(a.red - e.red),
+                            std::abs(a.green - e.green),
+                            std::abs(a.blue - e.blue)}) {
+        max_diff = std::max(max_diff, diff);
+        total_diff += diff;
+      }
+    }
+
+  DVC_LOG("diff vs ", reference, ": max=", max_diff,
+          " mean=", double(total_diff) / (3.0 * width * height));
+  if (max_diff > diff_tolerance)
+    DVC_FAIL("Output differs from reference by ", max_diff, " > ",
+             diff_tolerance);
+}
+
+// Largest per-channel difference as it would appear in the output image.
+Real contrast(Color a, Color b) {
+  Color d = abs(clamp(a, Real(0), Real(1)) - clamp(b, Real(0), Real(1)));
+  return std::max({d.r, d.g, d.b});
+}
+
+// Calls f(neighbor_index) for each of the up to 8 pixels around index.
+template <typename F>
+void for_each_neighbor(size_t index, F f) {
+  const int64_t row = index / width, col = index % width;
+  for (int64_t nrow = row - 1; nrow <= row + 1; nrow++)
+    for (int64_t ncol = col - 1; ncol <= col + 1; ncol++)
+      if (nrow >= 0 && nrow < height && ncol >= 0 && ncol < width &&
+          (nrow != row || ncol != col))
+        f(nrow * width + ncol);
+}
+
+std::filesystem::path pass_path(uint32_t pass) {
+  std::filesystem::path path = output;
+  return path.replace_extension(
+      dvc::concat(".pass", pass, path.extension().string()));
+}
+
+// Adaptive sampling: one ray per pixel first, then the full antialias grid
+// only for pixels that contrast with a neighbor.  Refining a pixel can
+// change it enough to expose a missed edge, so the unrefined neighbors of
+// pixels that changed are considered in the next pass, until none remain.
+void render_adaptive(const Scene& scene, std::vector<Color>& pixels) {
+  std::vector<bool> refined(pixels.size(), false);
+  std::vector<size_t> todo;
+
+  for (size_t i = 0; i < pixels.size(); i++) {
+    bool edge = false;
+    for_each_neighbor(i, [&](size_t n) {
+      edge = edge || contrast(pixels[i], pixels[n]) > adaptive_threshold;
+    });
+    if (edge) todo.push_back(i);
   }
-  return color;
+
+  size_t num_refined = 0;
+  uint32_t pass = 1;
+  for (; !todo.empty(); pass++) {
+    std::vector<size_t> changed;
+    for (size_t i : todo) {
+      if (refined[i]) continue;
+      refined[i] = true;
+      num_refined++;
+      Color before = pixels[i];
+      pixels[i] = render_pixel(scene, i / width, i % width, antialias);
+      if (contrast(before, pixels[i]) > adaptive_threshold)
+        changed.push_back(i);
+    }
+
+    if (progressive) write_image(pixels, pass_path(pass));
+
+    todo.clear();
+    for (size_t i : changed)
+      for_each_neighbor(i, [&](size_t n) {
+        if (!refined[n]) todo.push_back(n);
+      });
+  }
+
+  DVC_LOG("adaptive: refined ", num_refined, " of ", pixels.size(),
+          " pixels in ", pass - 1, " passes");
 }
 
-dvec3 render_pos(const Scene& scene, dvec2 pos) {
-  dvec3 viewpoint = center + pos.x * dir_right + pos.y * dir_up;
-  dvec3 dir = normalize(viewpoint - eye);
-  Ray ray = {eye, dir};
+// Renders and writes --tile_rows rows at a time, so memory is bounded by
+// the band size rather than the image size.
+void render_streaming(const Scene& scene) {
+  std::unique_ptr<ImageWriter> writer = open_image(output);
+  std::vector<Color> band(size_t(width) * tile_rows);
+  for (uint32_t first_row = 0; first_row < height; first_row += tile_rows) {
+    const uint32_t num_rows = std::min(tile_rows, height - first_row);
+    for (uint32_t row = 0; row < num_rows; row++)
+      for (uint32_t col = 0; col < width; col++)
+        band[row * width + col] =
+            render_pixel(scene, first_row + row, col, antialias);
+    writer->write_rows(first_row, num_rows, band.data());
+  }
+}
 
-  std::optional<ObjectHit> hit = scene.collide(ray);
+// Adaptive and progressive rendering revisit pixels, so they keep the
+// whole framebuffer.
+void render_framebuffer(const Scene& scene) {
+  std::vector<Color> pixels(size_t(width) * height);
 
-  if (!hit) return {0, 0, 0};
+  for (uint32_t row = 0; row < height; row++)
+    for (uint32_t col = 0; col < width; col++)
+      pixels[row * width + col] = render_pixel(scene, row, col, 1);
+
+  if (progressive) write_image(pixels, pass_path(0));
 
-  return shade(scene, ray, *hit);
+  if (adaptive && antialias > 1) {
+    render_adaptive(scene, pixels);
+  } else if (antialias > 1) {
+    for (uint32_t row = 0; row < height; row++)
+      for (uint32_t col = 0; col < width; col++)
+        pixels[row * width + col] = render_pixel(scene, row, col, antialias);
+  }
+
+  write_image(pixels, output);
+}
+
+double seconds(std::chrono::nanoseconds ns) {
+  return std::chrono::duration<double>(ns).count();
+}
+
+void write_stats_json(const TraceStats& total,
+                      std::chrono::duration<double> elapsed) {
+  std::ostringstream tiles;
+  for (uint32_t tile_row = 0; tile_row < num_tile_rows(); tile_row++) {
+    tiles << (tile_row ? ",\n      [" : "\n      [");
+    for (uint32_t tile_col = 0; tile_col < num_tile_cols(); tile_col++) {
+      size_t tile = tile_row * num_tile_cols() + tile_col;
+      tiles << (tile_col ? ", " : "")
+            << (tile < total.tile_time.size() ? seconds(total.tile_time[tile])
+                                              : 0);
+    }
+    tiles << "]";
+  }
+
+  dvc::save_file(
+      stats_json,
+      dvc::concat(
+          "{\n",
+          "  \"width\": ", width, ",\n",
+          "  \"height\": ", height, ",\n",
+          "  \"antialias\": ", antialias, ",\n",
+          "  \"precision\": \"", sizeof(Real) == 4 ? "float" : "double",
+          "\",\n",
+          "  \"elapsed_sec\": ", elapsed.count(), ",\n",
+          "  \"rays_per_sec\": ", total.rays() / elapsed.count(), ",\n",
+          "  \"camera_rays\": ", total.camera_rays, ",\n",
+          "  \"shadow_rays\": ", total.shadow_rays, ",\n",
+          "  \"shadow_occluded\": ", total.shadow_occluded, ",\n",
+          "  \"reflection_rays\": ", total.reflection_rays, ",\n",
+          "  \"roulette_terminated\": ", total.roulette_terminated, ",\n",
+          "  \"intersection_tests\": ", total.intersection_tests, ",\n",
+          "  \"hits\": ", total.hits, ",\n",
+          "  \"pixel_sec\": ", seconds(total.pixel_time()), ",\n",
+          "  \"intersection_sec\": ", seconds(total.intersection_time),
+          ",\n",
+          "  \"shading_sec\": ",
+          seconds(total.pixel_time() - total.intersection_time), ",\n",
+          "  \"tiles\": {\n",
+          "    \"tile_rows\": ", tile_rows, ",\n",
+          "    \"tile_cols\": ", tile_cols, ",\n",
+          "    \"sec\": [", tiles.str(), "\n    ]\n",
+          "  }\n",
+          "}\n"));
+}
+
+// One pixel per tile, from black (fastest) through red and yellow to white
+// (slowest).
+void write_heatmap(const TraceStats& total) {
+  std::chrono::nanoseconds slowest{1};
+  for (std::chrono::nanoseconds t : total.tile_time)
+    slowest = std::max(slowest, t);
+
+  png::image<png::rgba_pixel> image(num_tile_cols(), num_tile_rows());
+  for (uint32_t tile_row = 0; tile_row < num_tile_rows(); tile_row++)
+    for (uint32_t tile_col = 0; tile_col < num_tile_cols(); tile_col++) {
+      size_t tile = tile_row * num_tile_cols() + tile_col;
+      double heat = tile < total.tile_time.size()
+                        ? double(total.tile_time[tile].count()) /
+                              slowest.count()
+                        : 0;
+      image[tile_row][tile_col] = {
+          uint8_t(255 * std::clamp(3 * heat, 0.0, 1.0)),
+          uint8_t(255 * std::clamp(3 * heat - 1, 0.0, 1.0)),
+          uint8_t(255 * std::clamp(3 * heat - 2, 0.0, 1.0)), 255};
+    }
+  image.write(heatmap);
 }
 
 void render_image(const Scene& scene) {
-  png::image<png::rgba_pixel> image(height, width);
+  collect_timing = !stats_json.empty() || !heatmap.empty();
 
-  double dx = 1.0 / width / antialias;
-  double dy = 1.0 / height / antialias;
+  const auto start = std::chrono::steady_clock::now();
 
-  for (uint32_t row = 0; row < height; row++) {
-    double y = 1.0 - 2.0 * row / height;
-    for (uint32_t col = 0; col < width; col++) {
-      double x = 2.0 * col / width - 1.0;
-      dvec3 color(0, 0, 0);
-      for (uint32_t arow = 0; arow < antialias; arow++)
-        for (uint32_t acol = 0; acol < antialias; acol++) {
-          dvec2 pos(x + (1 + 2 * acol) * dx, y - (1 + 2 * arow) * dy);
-
-          //          DVC_LOG("SAMPLE: ", col, " ", row, " ", acol, " ", arow, "
-          //          ", pos.x,
-          //                  " ", pos.y);
-          color += render_pos(scene, pos);
-        }
+  if (adaptive || progressive)
+    render_framebuffer(scene);
+  else
+    render_streaming(scene);
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  const TraceStats total = total_stats();
+  DVC_LOG("rays: camera=", total.camera_rays, " shadow=", total.shadow_rays,
+          " (occluded=", total.shadow_occluded, ")",
+          " reflection=", total.reflection_rays,
+          " roulette_terminated=", total.roulette_terminated);
+  DVC_LOG("render: ", elapsed.count(), "s, ", total.rays() / elapsed.count(),
+          " rays/sec (", sizeof(Real) == 4 ? "float" : "double", ")");
+
+  if (!stats_json.empty()) write_stats_json(total, elapsed);
+  if (!heatmap.empty()) write_heatmap(total);
+
+  if (!reference.empty()) diff_reference();
+}
+
+// The scene script populates this through the bindings below.
+Scene scene;
+
+// Py_buffer that is released on scope exit.
+class Buffer {
+ public:
+  ~Buffer() {
+    if (acquired) PyBuffer_Release(&view);
+  }
+
+  // Requests a C-contiguous buffer whose struct format code is one of
+  // formats: 'f' (float32), 'd' (float64), 'l' or 'q' (int64).
+  bool acquire(PyObject* object, const char* name, const char* formats) {
+    if (PyObject_GetBuffer(object, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) <
+        0)
+      return false;
+    acquired = true;
+    const char* code = view.format ? view.format : "B";
+    if (*code == '@' || *code == '=' || *code == '<') code++;
+    format = *code;
+    if (std::strlen(code) != 1 || !std::strchr(formats, format) ||
+        size_t(view.itemsize) != (format == 'f' ? 4 : 8)) {
+      PyErr_Format(PyExc_TypeError,
+                   "%s: expected contiguous buffer of '%s' items, got '%s'",
+                   name, formats, code);
+      return false;
+    }
+    return true;
+  }
 
-      color /= antialias * antialias;
+  size_t size() const { return view.len / view.itemsize; }
+  const void* data() const { return view.buf; }
+
+  // Copies the items to dst: a memcpy when they are already T.
+  template <typename T>
+  void copy_to(T* dst) const {
+    switch (format) {
+      case 'f':
+        return copy_items<float>(dst);
+      case 'd':
+        return copy_items<double>(dst);
+      default:
+        return copy_items<int64_t>(dst);
+    }
+  }
 
-      image[row][col] = {uint8_t(255 * std::clamp(color.r, 0.0, 1.0)),
-                         uint8_t(255 * std::clamp(color.g, 0.0, 1.0)),
-                         uint8_t(255 * std::clamp(color.b, 0.0, 1.0)), 255};
+ private:
+  template <typename From, typename To>
+  void copy_items(To* dst) const {
+    if constexpr (std::is_same_v<From, To>) {
+      std::memcpy(dst, view.buf, view.len);
+    } else {
+      const From* src = (const From*)view.buf;
+      for (size_t i = 0; i < size(); i++) dst[i] = To(src[i]);
     }
   }
 
-  image.write(output);
+  Py_buffer view;
+  bool acquired = false;
+  char format;
+};
+
+// "O&" converters from a number and a 3-sequence of numbers.
+int to_real(PyObject* object, void* result) {
+  double d = PyFloat_AsDouble(object);
+  if (d == -1 && PyErr_Occurred()) return 0;
+  *(Real*)result = d;
+  return 1;
+}
+
+int to_vec3(PyObject* object, void* result) {
+  glm::dvec3 v;
+  PyObject* tuple = PySequence_Tuple(object);
+  if (!tuple) return 0;
+  int ok = PyArg_ParseTuple(tuple, "ddd", &v.x, &v.y, &v.z);
+  Py_DECREF(tuple);
+  if (ok) *(Vec3*)result = Vec3(v);
+  return ok;
+}
+
+bool check_material(long material) {
+  if (material < 0 || size_t(material) >= scene.materials.size()) {
+    PyErr_Format(PyExc_ValueError, "no such material: %ld", material);
+    return false;
+  }
+  return true;
+}
+
+// material(specular, diffuse, ambient, shininess, color, reflectance) -> id
+PyObject* material(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static const char* keywords[] = {"specular",  "diffuse", "ambient",
+                                   "shininess", "color",   "reflectance",
+                                   nullptr};
+  Material material = scene.materials.front();
+  if (!PyArg_ParseTupleAndKeywords(
+          args, kwargs, "|O&O&O&O&O&O&", (char**)keywords, to_real,
+          &material.specular, to_real, &material.diffuse, to_real,
+          &material.ambient, to_real, &material.shininess, to_vec3,
+          &material.color, to_real, &material.reflectance))
+    return nullptr;
+  scene.materials.push_back(material);
+  return PyLong_FromSize_t(scene.materials.size() - 1);
 }
 
-PyObject* hello(PyObject* self, PyObject* args) {
-  DVC_LOG("Hello, World!");
-  return Py_None;
+// sphere(pos, radius, material=0)
+PyObject* sphere(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static const char* keywords[] = {"pos", "radius", "material", nullptr};
+  Vec3 pos;
+  Real radius;
+  long material = 0;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O&O&|l", (char**)keywords,
+                                   to_vec3, &pos, to_real, &radius, &material))
+    return nullptr;
+  if (!check_material(material)) return nullptr;
+  scene.objects.push_back(
+      new Sphere(pos, radius, scene.materials[material]));
+  Py_RETURN_NONE;
 }
 
-PyMethodDef hello_def = {"hello", hello, METH_VARARGS, "Say hello"};
+// spheres(centers, radii, material=0, materials=None)
+//
+// centers is an (n, 3) and radii an (n,) float32 or float64 buffer (numpy
+// arrays, array.array, memoryview...).  materials, if given, is an (n,)
+// int64 buffer of material ids; otherwise every sphere uses material.  The
+// geometry is copied straight out of the buffers with no per-sphere Python
+// calls, as a memcpy when the buffers match the tracer precision.
+PyObject* spheres(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static const char* keywords[] = {"centers", "radii", "material",
+                                   "materials", nullptr};
+  PyObject* centers_object;
+  PyObject* radii_object;
+  long material = 0;
+  PyObject* materials_object = Py_None;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|lO", (char**)keywords,
+                                   &centers_object, &radii_object, &material,
+                                   &materials_object))
+    return nullptr;
+
+  Buffer centers, radii;
+  if (!centers.acquire(centers_object, "centers", "fd") ||
+      !radii.acquire(radii_object, "radii", "fd"))
+    return nullptr;
+  const size_t n = radii.size();
+  if (centers.size() != 3 * n) {
+    PyErr_Format(PyExc_ValueError,
+                 "centers has %zu values, expected 3 * %zu radii",
+                 centers.size(), n);
+    return nullptr;
+  }
+
+  static_assert(sizeof(Vec3) == 3 * sizeof(Real));
+  auto set = std::make_unique<SphereSet>(scene.materials);
+  set->centers.resize(n);
+  set->radii.resize(n);
+  centers.copy_to((Real*)set->centers.data());
+  radii.copy_to(set->radii.data());
+
+  if (materials_object == Py_None) {
+    if (!check_material(material)) return nullptr;
+    set->material_ids.assign(n, material);
+  } else {
+    Buffer materials;
+    if (!materials.acquire(materials_object, "materials", "lq"))
+      return nullptr;
+    if (materials.size() != n) {
+      PyErr_Format(PyExc_ValueError, "materials has %zu values, expected %zu",
+                   materials.size(), n);
+      return nullptr;
+    }
+    const int64_t* ids = (const int64_t*)materials.data();
+    set->material_ids.resize(n);
+    for (size_t i = 0; i < n; i++) {
+      if (!check_material(ids[i])) return nullptr;
+      set->material_ids[i] = ids[i];
+    }
+  }
+
+  scene.objects.push_back(set.release());
+  Py_RETURN_NONE;
+}
+
+// light(pos, diffuse=(1, 1, 1), specular=(1, 1, 1))
+PyObject* light(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static const char* keywords[] = {"pos", "diffuse", "specular", nullptr};
+  Light light = {{0, 0, 0}, {1, 1, 1}, {1, 1, 1}};
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O&|O&O&", (char**)keywords,
+                                   to_vec3, &light.source, to_vec3,
+                                   &light.diffuse, to_vec3, &light.specular))
+    return nullptr;
+  scene.lights.push_back(light);
+  Py_RETURN_NONE;
+}
+
+// camera(eye, lookat, up=(0, 1, 0), fov=90)
+PyObject* camera(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static const char* keywords[] = {"eye", "lookat", "up", "fov", nullptr};
+  Camera& camera = scene.camera;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O&O&O&O&", (char**)keywords,
+                                   to_vec3, &camera.eye, to_vec3,
+                                   &camera.lookat, to_vec3, &camera.up,
+                                   to_real, &camera.fov))
+    return nullptr;
+  Py_RETURN_NONE;
+}
+
+// ambient(color)
+PyObject* ambient(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static const char* keywords[] = {"color", nullptr};
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O&", (char**)keywords,
+                                   to_vec3, &scene.ambient))
+    return nullptr;
+  Py_RETURN_NONE;
+}
+
+std::vector<std::shared_ptr<const Mesh>> meshes;
+std::map<std::filesystem::path, size_t> mesh_ids;
+
+// mesh(path) -> id
+//
+// Loads an OBJ file once; loading the same path again returns the same id.
+PyObject* mesh(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static const char* keywords[] = {"path", nullptr};
+  const char* path;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s", (char**)keywords, &path))
+    return nullptr;
+  auto [it, inserted] = mesh_ids.emplace(path, meshes.size());
+  if (inserted) meshes.push_back(Mesh::load_obj(path));
+  return PyLong_FromSize_t(it->second);
+}
+
+// Rotation of angle degrees about axis.
+Mat3 rotation(Vec3 axis, Real angle) {
+  const Vec3 a = normalize(axis);
+  const Real c = std::cos(glm::radians(angle)), s = std::sin(glm::radians(angle));
+  Mat3 result;
+  for (int j = 0; j < 3; j++) {
+    Vec3 e(0);
+    e[j] = 1;
+    result[j] = c * e + s * cross(a, e) + (1 - c) * a[j] * a;
+  }
+  return result;
+}
+
+// instance(mesh, pos=(0, 0, 0), scale=1, axis=(0, 1, 0), angle=0,
+//          material=0)
+//
+// Places a mesh, scaled then rotated angle degrees about axis then moved to
+// pos.  Instances share the mesh geometry.
+PyObject* instance(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static const char* keywords[] = {"mesh",  "pos",      "scale", "axis",
+                                   "angle", "material", nullptr};
+  long mesh;
+  Vec3 pos(0, 0, 0), axis(0, 1, 0);
+  Real scale = 1, angle = 0;
+  long material = 0;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "l|O&O&O&O&l",
+                                   (char**)keywords, &mesh, to_vec3, &pos,
+                                   to_real, &scale, to_vec3, &axis, to_real,
+                                   &angle, &material))
+    return nullptr;
+  if (mesh < 0 || size_t(mesh) >= meshes.size()) {
+    PyErr_Format(PyExc_ValueError, "no such mesh: %ld", mesh);
+    return nullptr;
+  }
+  if (!check_material(material)) return nullptr;
+  scene.objects.push_back(new MeshInstance(meshes[mesh],
+                                           scale * rotation(axis, angle), pos,
+                                           scene.materials[material]));
+  Py_RETURN_NONE;
+}
+
+PyMethodDef scene_defs[] = {
+    {"material", (PyCFunction)material, METH_VARARGS | METH_KEYWORDS,
+     "Define a material, returns its id"},
+    {"sphere", (PyCFunction)sphere, METH_VARARGS | METH_KEYWORDS,
+     "Add a sphere"},
+    {"spheres", (PyCFunction)spheres, METH_VARARGS | METH_KEYWORDS,
+     "Add many spheres from buffers"},
+    {"mesh", (PyCFunction)mesh, METH_VARARGS | METH_KEYWORDS,
+     "Load an OBJ mesh, returns its id"},
+    {"instance", (PyCFunction)instance, METH_VARARGS | METH_KEYWORDS,
+     "Place a mesh"},
+    {"light", (PyCFunction)light, METH_VARARGS | METH_KEYWORDS,
+     "Add a point light"},
+    {"camera", (PyCFunction)camera, METH_VARARGS | METH_KEYWORDS,
+     "Place the camera"},
+    {"ambient", (PyCFunction)ambient, METH_VARARGS | METH_KEYWORDS,
+     "Set the ambient light"},
+};
 
 int main(int argc, char** argv) {
   dvc::program program(argc, argv);
 
   if (dvc::args.empty()) DVC_FAIL("Must specify input file");
+  if (tile_rows == 0) DVC_FAIL("--tile_rows must be positive");
+  if (tile_cols == 0) DVC_FAIL("--tile_cols must be positive");
 
   std::filesystem::path input_file = dvc::args.at(0);
 
@@ -261,9 +886,10 @@ int main(int argc, char** argv) {
   PyObject* global_dict = PyDict_New();
   PyDict_SetItemString(global_dict, "__builtins__", PyEval_GetBuiltins());
 
-  PyObject* hello_function = PyCFunction_New(&hello_def, Py_None);
+  for (PyMethodDef& def : scene_defs)
+    PyDict_SetItemString(global_dict, def.ml_name,
+                         PyCFunction_New(&def, Py_None));
 
-  PyDict_SetItemString(global_dict, "hello", hello_function);
   PyObject* local_dict = PyDict_New();
 
   PyObject* eval_code = PyEval_EvalCode(compiled, global_dict, local_dict);
@@ -275,21 +901,5 @@ int main(int argc, char** argv) {
 
   Py_Finalize();
 
-  Scene scene;
-  scene.ambient = {1, 1, 1};
-
-  std::random_device r;
-  std::default_random_engine e1(r());
-  std::uniform_int_distribution<int> uniform_dist1(-10, 10);
-  std::uniform_int_distribution<int> uniform_dist2(1, 10);
-
-  scene.lights.push_back(Light{{1, 100, -100}, {1, 1, 1}, {1, 1, 1}});
-
-  for (int i = 0; i < 100; i++) {
-    scene.objects.push_back(new Sphere(
-        {uniform_dist1(e1), uniform_dist1(e1), uniform_dist1(e1) + 30},
-        uniform_dist2(e1), {0.33, 0.33, 0.33, 100, {1, 0, 0}}));
-  }
-
   render_image(scene);
 }
@@ -0,0 +1,64 @@
+#include "test/frame_ring.h"
+
+#include <algorithm>
+
+#include "dvc/log.h"
+#include "spk/memory.h"
+
+namespace {
+
+uint64_t align_up(uint64_t size, uint64_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace
+
+void FrameRing::map() {
+  device_memory.map_memory(0, num_regions * region_size, data);
+}
+
+void FrameRing::unmap() { device_memory.unmap_memory(); }
+
+void FrameRing::begin(size_t rendering_index) {
+  DVC_ASSERT_LT(rendering_index, num_regions);
+  region_start = rendering_index * region_size;
+  used = 0;
+}
+
+FrameRing::Allocation FrameRing::allocate(uint64_t size) {
+  DVC_ASSERT(used + size <= region_size, "frame ring region of ", region_size,
+             " bytes has ", region_size - used, " left, not ", size);
+  const uint64_t offset = region_start + used;
+  used += align_up(size, alignment);
+  return {(char*)data + offset, offset};
+}
+
+FrameRing create_frame_ring(spk::physical_device& physical_device,
+                            spk::device& device, uint32_t num_regions,
+                            const std::vector<uint64_t>& frame_allocations,
+                            spk::buffer_usage_flags usage) {
+  spk::physical_device_properties properties = physical_device.properties();
+  const uint64_t alignment = std::max<uint64_t>(
+      {properties.limits().min_uniform_buffer_offset_alignment(),
+       properties.limits().non_coherent_atom_size(), alignof(std::max_align_t)});
+  uint64_t region_size = 0;
+  for (uint64_t size : frame_allocations)
+    region_size += align_up(size, alignment);
+
+  spk::buffer buffer =
+      spkx::create_buffer(device, num_regions * region_size, usage);
+  const spk::memory_requirements memory_requirements =
+      buffer.memory_requirements();
+  spk::device_memory device_memory = spkx::create_memory(
+      device, memory_requirements.size(),
+      spkx::find_compatible_memory_type(
+          physical_device, memory_requirements.memory_type_bits(),
+          spk::memory_property_flags::host_visible |
+              spk::memory_property_flags::host_coherent));
+  buffer.bind_memory(device_memory, 0);
+
+  FrameRing ring{std::move(buffer), std::move(device_memory), num_regions,
+                 region_size, alignment};
+  ring.map();
+  return ring;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "spk/spock.h"
+
+// One host visible buffer for what each frame uploads, such as vertices and
+// uniforms, mapped for its whole life and split into a region per
+// rendering.  An upload is an offset bumped within its rendering's region,
+// so the number of allocations on the device stays constant.  A region is
+// only reused when its rendering is prepared again, by when the device is
+// done with what the rendering last read from it.
+struct FrameRing {
+  // Where an upload is written, and where it is bound from in buffer.
+  struct Allocation {
+    void* data;
+    uint64_t offset;
+  };
+
+  void map();
+  void unmap();
+
+  // Starts allocating from the start of rendering_index's region.
+  void begin(size_t rendering_index);
+
+  // size bytes in the region of the rendering begun last, at an offset
+  // that is a multiple of alignment.
+  Allocation allocate(uint64_t size);
+
+  spk::buffer buffer;
+  spk::device_memory device_memory;
+  uint32_t num_regions;
+  // A multiple of alignment.
+  uint64_t region_size;
+  // Of offsets bound as uniform buffers, and of ranges flushed from
+  // memory that is not host coherent.
+  uint64_t alignment;
+  void* data = nullptr;
+  uint64_t region_start = 0;
+  uint64_t used = 0;
+};
+
+// A ring of num_regions regions, each with room for an allocation of each of
+// frame_allocations bytes.
+FrameRing create_frame_ring(spk::physical_device& physical_device,
+                            spk::device& device, uint32_t num_regions,
+                            const std::vector<uint64_t>& frame_allocations,
+                            spk::buffer_usage_flags usage);
@@ -0,0 +1,93 @@
+#include "test/particles.h"
+
+#include <cmath>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#define PARTICLES_KERNEL __attribute__((target_clones("avx2", "default")))
+
+namespace {
+
+// Sets flush to zero and denormals are zero for a kernel's duration.  A
+// damped point settling on a target at 0 decays through denormal
+// velocities and positions, which x86 handles many times slower.
+class FlushDenormals {
+ public:
+#ifdef __SSE__
+  FlushDenormals() : saved(_mm_getcsr()) { _mm_setcsr(saved | 0x8040); }
+  ~FlushDenormals() { _mm_setcsr(saved); }
+
+ private:
+  const unsigned saved;
+#endif
+};
+
+[[gnu::always_inline]] inline void step_point(float& pos, float& vel,
+                                              float alpha, float beta,
+                                              float gamma, float target) {
+  float v = (vel + beta * (target - pos)) * (1 - gamma);
+  const float p = pos + alpha * v;
+  v = std::abs(p) > 1 && p * v > 0 ? -v : v;
+  pos = p;
+  vel = v;
+}
+
+}  // namespace
+
+PARTICLES_KERNEL void step_axis(float* pos, float* vel, size_t n, float alpha,
+                                float beta, float gamma, float target,
+                                float* before, float* after) {
+  FlushDenormals flush;
+  if (before && after) {
+    for (size_t i = 0; i < n; i++) {
+      before[i] = pos[i];
+      step_point(pos[i], vel[i], alpha, beta, gamma, target);
+      after[i] = pos[i];
+    }
+  } else {
+    for (size_t i = 0; i < n; i++)
+      step_point(pos[i], vel[i], alpha, beta, gamma, target);
+  }
+}
+
+namespace {
+
+template <size_t dims>
+[[gnu::always_inline]] inline void interleave(const Positions<dims>& previous,
+                                              const Positions<dims>& current,
+                                              const std::vector<float>& colors,
+                                              float t, float* out) {
+  std::array<const float*, dims> from, to;
+  for (size_t axis = 0; axis < dims; axis++) {
+    from[axis] = previous[axis].data();
+    to[axis] = current[axis].data();
+  }
+  const float* color = colors.data();
+  const size_t n = current[0].size();
+  for (size_t i = 0; i < n; i++) {
+    float* vertex = out + i * (dims + 3);
+    for (size_t axis = 0; axis < dims; axis++)
+      vertex[axis] = from[axis][i] + t * (to[axis][i] - from[axis][i]);
+    for (size_t c = 0; c < 3; c++) vertex[dims + c] = color[3 * i + c];
+  }
+}
+
+}  // namespace
+
+PARTICLES_KERNEL void write_vertices(const Positions<2>& previous,
+                                     const Positions<2>& current,
+                                     const std::vector<float>& colors,
+                                     float t, float* out) {
+  FlushDenormals flush;
+  interleave(previous, current, colors, t, out);
+}
+
+PARTICLES_KERNEL void write_vertices(const Positions<3>& previous,
+                                     const Positions<3>& current,
+                                     const std::vector<float>& colors,
+                                     float t, float* out) {
+  FlushDenormals flush;
+  interleave(previous, current, colors, t, out);
+}
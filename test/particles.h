@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+// Point masses stored as a structure of arrays, one float array per axis,
+// so that a step is a branch-free loop over contiguous floats.  The loops
+// are compiled for AVX2 as well as the baseline and the CPU picks at load
+// time.
+
+// One step of n points along one axis: attraction toward target by beta,
+// damping by gamma, integration by alpha, and reflection of any velocity
+// carrying its point further outside [-1, 1].  If before and after are
+// given, they receive the positions from before and after the step in the
+// same pass.
+void step_axis(float* pos, float* vel, size_t n, float alpha, float beta,
+               float gamma, float target, float* before = nullptr,
+               float* after = nullptr);
+
+// The position of each point along each axis, at [axis][i].
+template <size_t dims>
+using Positions = std::array<std::vector<float>, dims>;
+
+// Writes a vertex per point to out, interleaved as the demos' Vertex
+// structs are: the position along each axis, from previous to current by
+// t, then the point's red, green and blue from colors.
+void write_vertices(const Positions<2>& previous, const Positions<2>& current,
+                    const std::vector<float>& colors, float t, float* out);
+void write_vertices(const Positions<3>& previous, const Positions<3>& current,
+                    const std::vector<float>& colors, float t, float* out);
+
+template <size_t dims>
+struct Particles {
+  explicit Particles(size_t size) : size(size), colors(3 * size) {
+    for (size_t axis = 0; axis < dims; axis++) {
+      pos[axis].resize(size);
+      vel[axis].resize(size);
+    }
+  }
+
+  void step(float alpha, float beta, float gamma,
+            const std::array<float, dims>& target) {
+    for (size_t axis = 0; axis < dims; axis++)
+      step_axis(pos[axis].data(), vel[axis].data(), size, alpha, beta, gamma,
+                target[axis]);
+  }
+
+  // Also writes the positions from before and after the step, as a
+  // snapshot for rendering.
+  void step(float alpha, float beta, float gamma,
+            const std::array<float, dims>& target, Positions<dims>& before,
+            Positions<dims>& after) {
+    for (size_t axis = 0; axis < dims; axis++) {
+      before[axis].resize(size);
+      after[axis].resize(size);
+      step_axis(pos[axis].data(), vel[axis].data(), size, alpha, beta, gamma,
+                target[axis], before[axis].data(), after[axis].data());
+    }
+  }
+
+  size_t size;
+  Positions<dims> pos;
+  // Along each axis, like pos.
+  std::array<std::vector<float>, dims> vel;
+  // Red, green and blue of point i from colors[3 * i].
+  std::vector<float> colors;
+};
@@ -0,0 +1,145 @@
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "dvc/file.h"
+#include "dvc/opts.h"
+#include "dvc/program.h"
+#include "test/particles.h"
+
+// Times a pointtest frame for 1k to 10M points: one simulation step that
+// publishes a snapshot of the points before and after it, and one write of
+// vertices interpolated from the snapshot, as rendering does.  Each frame is
+// run as pointtest did with an array of PointMass structs and as it does
+// with Particles.
+
+double DVC_OPTION(seconds, -, 1, "time spent on each case, in seconds");
+std::string DVC_OPTION(json, -, "", "if set, also write results here");
+
+struct Result {
+  size_t num_points;
+  double aos_ns_per_point;
+  double soa_ns_per_point;
+};
+
+struct Vertex {
+  glm::vec2 pos;
+  glm::vec3 color;
+};
+
+// pointtest's PointMass before Particles.
+struct PointMass {
+  glm::vec2 pos;
+  glm::vec3 color;
+  glm::vec2 velocity;
+  void update(float alpha, float beta, float gamma, glm::vec2 mouse_pos) {
+    glm::vec2 dmouse = mouse_pos - pos;
+
+    velocity += beta * dmouse;
+
+    velocity *= 1 - gamma;
+
+    pos += alpha * velocity;
+
+    auto adjust = [](float& pos, float& vel) {
+      if (pos > 1 && vel > 0) vel = -vel;
+      if (pos < -1 && vel < 0) vel = -vel;
+    };
+    adjust(pos.x, velocity.x);
+    adjust(pos.y, velocity.y);
+  }
+};
+
+// Median time of frame() over repeated runs lasting about --seconds, per
+// point.  The median rather than the mean, so that the odd preempted run
+// does not skew the small cases.
+template <typename Frame>
+double time_per_point(size_t num_points, Frame frame) {
+  using Clock = std::chrono::steady_clock;
+  std::vector<Clock::duration> runs;
+  const auto budget = std::chrono::duration<double>(seconds);
+  const Clock::time_point start = Clock::now();
+  for (Clock::time_point end = start; end - start < budget || runs.size() < 3;) {
+    const Clock::time_point run_start = end;
+    frame(runs.size());
+    end = Clock::now();
+    runs.push_back(end - run_start);
+  }
+  std::nth_element(runs.begin(), runs.begin() + runs.size() / 2, runs.end());
+  return std::chrono::duration<double, std::nano>(runs[runs.size() / 2])
+             .count() /
+         num_points;
+}
+
+int main(int argc, char** argv) {
+  dvc::program program(argc, argv);
+
+  std::mt19937 rng(1);
+  std::normal_distribution<float> normal;
+  std::vector<Result> results;
+  for (size_t num_points = 1000; num_points <= 10000000; num_points *= 10) {
+    Result result = {num_points};
+    std::vector<Vertex> vertices(num_points);
+    {
+      std::vector<PointMass> points(num_points);
+      for (PointMass& point : points) {
+        point.pos = {normal(rng), normal(rng)};
+        point.color = {normal(rng), normal(rng), normal(rng)};
+        point.velocity = {normal(rng), normal(rng)};
+      }
+      std::vector<Vertex> previous(num_points), current(num_points);
+      auto get_vertices = [&](std::vector<Vertex>& snapshot) {
+        for (size_t i = 0; i < num_points; ++i)
+          snapshot[i] = {points[i].pos, points[i].color};
+      };
+      result.aos_ns_per_point = time_per_point(num_points, [&](size_t run) {
+        const glm::vec2 mouse{run % 2 ? 0.5f : -0.5f, 0};
+        get_vertices(previous);
+        for (PointMass& point : points) point.update(0.01, 0.1, 0.01, mouse);
+        get_vertices(current);
+        for (size_t i = 0; i < num_points; ++i) {
+          vertices[i].color = current[i].color;
+          vertices[i].pos = glm::mix(previous[i].pos, current[i].pos, 0.5f);
+        }
+      });
+    }
+    {
+      Particles<2> particles(num_points);
+      for (size_t axis = 0; axis < 2; axis++) {
+        for (float& x : particles.pos[axis]) x = normal(rng);
+        for (float& v : particles.vel[axis]) v = normal(rng);
+      }
+      for (float& c : particles.colors) c = normal(rng);
+      Positions<2> previous, current;
+      result.soa_ns_per_point = time_per_point(num_points, [&](size_t run) {
+        particles.step(0.01, 0.1, 0.01, {run % 2 ? 0.5f : -0.5f, 0}, previous,
+                       current);
+        write_vertices(previous, current, particles.colors, 0.5,
+                       (float*)vertices.data());
+      });
+    }
+    DVC_LOG(num_points, " points: ", result.aos_ns_per_point,
+            " ns/point array of structs, ", result.soa_ns_per_point,
+            " ns/point Particles, ",
+            result.aos_ns_per_point / result.soa_ns_per_point, "x");
+    results.push_back(result);
+  }
+
+  if (!json.empty()) {
+    std::ostringstream out;
+    out << "{\n  \"cases\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+      const Result& result = results[i];
+      out << (i ? "," : "") << "\n    {\"num_points\": " << result.num_points
+          << ", \"aos_ns_per_point\": " << result.aos_ns_per_point
+          << ", \"soa_ns_per_point\": " << result.soa_ns_per_point << "}";
+    }
+    out << "\n  ]\n}\n";
+    dvc::save_file(json, out.str());
+  }
+}
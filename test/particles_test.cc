@@ -0,0 +1,83 @@
+#include "test/particles.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "dvc/program.h"
+
+int main() {
+  dvc::program program;
+
+  std::mt19937 rng(1);
+  std::normal_distribution<float> normal;
+
+  // step_axis matches a point by point step, with and without a snapshot,
+  // for sizes on and off the vector width.
+  for (size_t n : {0, 1, 7, 8, 9, 1000, 1003}) {
+    std::vector<float> pos(n), vel(n);
+    for (size_t i = 0; i < n; i++) {
+      pos[i] = 2 * normal(rng);
+      vel[i] = normal(rng);
+    }
+    std::vector<float> expected_pos = pos, expected_vel = vel;
+    for (size_t i = 0; i < n; i++) {
+      float& p = expected_pos[i];
+      float& v = expected_vel[i];
+      v += 0.1f * (0.5f - p);
+      v *= 1 - 0.01f;
+      p += 0.01f * v;
+      if (p > 1 && v > 0) v = -v;
+      if (p < -1 && v < 0) v = -v;
+    }
+
+    const std::vector<float> start = pos;
+    std::vector<float> snapshot_pos = pos, snapshot_vel = vel;
+    std::vector<float> before(n), after(n);
+    step_axis(snapshot_pos.data(), snapshot_vel.data(), n, 0.01, 0.1, 0.01,
+              0.5, before.data(), after.data());
+    step_axis(pos.data(), vel.data(), n, 0.01, 0.1, 0.01, 0.5);
+    for (size_t i = 0; i < n; i++) {
+      DVC_ASSERT_LT(std::abs(pos[i] - expected_pos[i]), 1e-6);
+      DVC_ASSERT_LT(std::abs(vel[i] - expected_vel[i]), 1e-6);
+      DVC_ASSERT_EQ(snapshot_pos[i], pos[i]);
+      DVC_ASSERT_EQ(snapshot_vel[i], vel[i]);
+      DVC_ASSERT_EQ(before[i], start[i]);
+      DVC_ASSERT_EQ(after[i], pos[i]);
+    }
+  }
+
+  // A step with a snapshot records the positions on both sides of it.
+  {
+    Particles<3> particles(5);
+    for (size_t axis = 0; axis < 3; axis++)
+      for (size_t i = 0; i < 5; i++) {
+        particles.pos[axis][i] = normal(rng);
+        particles.vel[axis][i] = normal(rng);
+      }
+    const Positions<3> start = particles.pos;
+    Positions<3> previous, current;
+    particles.step(0.01, 0, 0, {0, 0, 0}, previous, current);
+    DVC_ASSERT(previous == start);
+    DVC_ASSERT(current == particles.pos);
+  }
+
+  // Vertices interleave the interpolated position with the color.
+  {
+    const Positions<2> previous = {{{0, 1}, {2, 3}}};
+    const Positions<2> current = {{{4, 5}, {6, 7}}};
+    const std::vector<float> colors = {10, 11, 12, 13, 14, 15};
+    std::vector<float> vertices(10);
+    write_vertices(previous, current, colors, 0.25, vertices.data());
+    DVC_ASSERT(vertices ==
+               std::vector<float>({1, 3, 10, 11, 12, 2, 4, 13, 14, 15}));
+  }
+  {
+    const Positions<3> previous = {{{0}, {2}, {4}}};
+    const Positions<3> current = {{{2}, {4}, {6}}};
+    const std::vector<float> colors = {10, 11, 12};
+    std::vector<float> vertices(6);
+    write_vertices(previous, current, colors, 0.5, vertices.data());
+    DVC_ASSERT(vertices == std::vector<float>({1, 3, 5, 10, 11, 12}));
+  }
+}
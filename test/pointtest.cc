@@ -1,10 +1,16 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_vulkan.h>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <functional>
 #include <glm/glm.hpp>
+#include <memory>
+#include <optional>
 #include <random>
 #include <set>
 
@@ -13,17 +19,30 @@
 #include "dvc/terminate.h"
 #include "spk/helpers.h"
 #include "spk/loader.h"
+#include "spk/memory.h"
 #include "spk/spock.h"
 // #include "spk/presenter.h"
 #include "spk/game.h"
 // #include "spk/rendering.h"
 #include "dvc/log.h"
 #include "dvc/opts.h"
+#include "test/frame_ring.h"
+#include "test/particles.h"
+#include "test/simulation.h"
 
 namespace {
 
 bool DVC_OPTION(trace_allocations, -, false, "trace vulkan allocations");
 uint64_t DVC_OPTION(num_points, -, 100, "num of points");
+double DVC_OPTION(sim_rate, -, 60, "simulation steps per second");
+bool DVC_OPTION(compute, -, false,
+                "keep the points in a device storage buffer and step them in "
+                "a compute shader");
+bool DVC_OPTION(check_compute, -, false,
+                "with --compute, first check one step of the compute shader "
+                "against Particles::step and fail if they differ");
+uint64_t DVC_OPTION(frames, -, 0,
+                    "if nonzero, exit after rendering this many frames");
 
 struct Pipeline {
   //  spk::shader_module vertex_shader, fragment_shader;
@@ -42,154 +61,120 @@ struct Vertex {
   glm::vec2 pos;
   glm::vec3 color;
 };
+// As write_vertices writes them.
+static_assert(sizeof(Vertex) == 5 * sizeof(float));
 
-struct PointMass {
+// A point as test/pointtest.comp stores it, std430 layout.  The
+// graphics pipeline reads pos and color as vertex attributes straight from
+// the storage buffer.
+struct GpuPoint {
   glm::vec2 pos;
-  glm::vec3 color;
   glm::vec2 velocity;
-  void update(float alpha, float beta, float gamma, glm::vec2 mouse_pos) {
-    glm::vec2 dmouse = mouse_pos - pos;
-
-    velocity += beta * dmouse;
-
-    velocity *= 1 - gamma;
-
-    pos += alpha * velocity;
+  glm::vec4 color;
+};
+static_assert(sizeof(GpuPoint) == 32);
 
-    auto adjust = [](float& pos, float& vel) {
-      if (pos > 1 && vel > 0) vel = -vel;
-      if (pos < -1 && vel < 0) vel = -vel;
-    };
-    adjust(pos.x, velocity.x);
-    adjust(pos.y, velocity.y);
-  }
+// The uniform block of test/pointtest.comp, std140 layout.
+struct ComputeParams {
+  glm::vec2 mouse_pos;
+  float alpha, beta, gamma;
+  uint32_t num_points;
 };
 
-spk::vertex_input_binding_description get_vertex_input_binding_description() {
+// Vertices of stride bytes, Vertex or GpuPoint.
+spk::vertex_input_binding_description get_vertex_input_binding_description(
+    uint32_t stride) {
   spk::vertex_input_binding_description vertex_input_binding_description;
   vertex_input_binding_description.set_binding(0);
   vertex_input_binding_description.set_input_rate(
       spk::vertex_input_rate::vertex);
-  vertex_input_binding_description.set_stride(sizeof(Vertex));
+  vertex_input_binding_description.set_stride(stride);
   return vertex_input_binding_description;
 }
 
 std::vector<spk::vertex_input_attribute_description>
-get_vertex_input_attribute_descriptions() {
+get_vertex_input_attribute_descriptions(uint32_t pos_offset,
+                                        uint32_t color_offset) {
   std::vector<spk::vertex_input_attribute_description> result(2);
   result[0].set_binding(0);
   result[0].set_location(0);
   result[0].set_format(spk::format::r32g32_sfloat);
-  result[0].set_offset(offsetof(Vertex, pos));
+  result[0].set_offset(pos_offset);
   result[1].set_binding(0);
   result[1].set_location(1);
-  result[1].set_offset(offsetof(Vertex, color));
+  result[1].set_offset(color_offset);
   result[1].set_format(spk::format::r32g32b32_sfloat);
   return result;
 }
 
-spk::buffer create_buffer(spk::device& device) {
-  spk::buffer_create_info buffer_create_info;
-  buffer_create_info.set_size(sizeof(Vertex) * num_points);
-  buffer_create_info.set_usage(spk::buffer_usage_flags::vertex_buffer);
-  buffer_create_info.set_sharing_mode(spk::sharing_mode::exclusive);
-  return device.create_buffer(buffer_create_info);
-}
-
-uint32_t find_compatible_memory_type(spk::physical_device& physical_device,
-                                     spk::buffer& buffer) {
-  const spk::memory_requirements memory_requirements =
-      buffer.memory_requirements();
-
-  static constexpr spk::memory_property_flags flags =
-      spk::memory_property_flags::host_visible |
-      spk::memory_property_flags::host_coherent;
-
-  spk::physical_device_memory_properties memory_properties =
-      physical_device.memory_properties();
-  for (uint32_t i = 0; i < memory_properties.memory_type_count(); ++i) {
-    if (!(memory_requirements.memory_type_bits() & (1 << i))) continue;
-    if (memory_properties.memory_types()[i].property_flags() & flags) return i;
-  }
-  DVC_FATAL("no compatible memory type found");
-}
-
-spk::device_memory create_memory(spk::physical_device& physical_device,
-                                 spk::device& device, spk::buffer& buffer) {
-  const spk::memory_requirements memory_requirements =
-      buffer.memory_requirements();
-  spk::memory_allocate_info memory_allocate_info;
-  memory_allocate_info.set_allocation_size(memory_requirements.size());
-  memory_allocate_info.set_memory_type_index(
-      find_compatible_memory_type(physical_device, buffer));
-  return device.allocate_memory(memory_allocate_info);
-}
+// Particles::step's parameters for each simulation step.
+constexpr float step_alpha = 0.01, step_beta = 0.1, step_gamma = 0.01;
 
 struct World {
-  World(size_t num_points) : num_points(num_points), points(::num_points) {
+  World(size_t num_points) : num_points(num_points), particles(num_points) {
     rng.seed(std::random_device()());
 
     for (size_t i = 0; i < num_points; ++i) {
-      points[i].pos = glm::vec2{normal(), normal()};
-      points[i].color = glm::vec3{normal(), normal(), normal()};
-      points[i].velocity = glm::vec2{normal(), normal()};
-      points[i].update(0, 0, 0, glm::vec2{0, 0});
+      for (size_t axis = 0; axis < 2; axis++) particles.pos[axis][i] = normal();
+      for (size_t c = 0; c < 3; c++) particles.colors[3 * i + c] = normal();
+      for (size_t axis = 0; axis < 2; axis++) particles.vel[axis][i] = normal();
     }
+    particles.step(0, 0, 0, {0, 0});
   }
 
-  void update(float alpha, float beta, float gamma) {
-    for (auto& point : points) point.update(alpha, beta, gamma, mouse_pos);
+  // Steps the points, writing their positions from before and after the
+  // step to previous and current.
+  void update(float alpha, float beta, float gamma, Positions<2>& previous,
+              Positions<2>& current) {
+    const glm::vec2 mouse = mouse_pos();
+    particles.step(alpha, beta, gamma, {mouse.x, mouse.y}, previous, current);
   }
 
   float normal() { return normal_(rng); }
 
-  void set_mouse_pos(glm::vec2 mouse_pos) { this->mouse_pos = mouse_pos; }
+  // Called from the event thread while the simulation runs.  A step may see
+  // one coordinate of a move before the other, which is harmless.
+  void set_mouse_pos(glm::vec2 mouse_pos) {
+    mouse_x.store(mouse_pos.x, std::memory_order_relaxed);
+    mouse_y.store(mouse_pos.y, std::memory_order_relaxed);
+  }
 
-  glm::vec2 mouse_pos;
+  glm::vec2 mouse_pos() const {
+    return {mouse_x.load(std::memory_order_relaxed),
+            mouse_y.load(std::memory_order_relaxed)};
+  }
+
+  std::atomic<float> mouse_x = 0, mouse_y = 0;
   std::normal_distribution<float> normal_;
   std::mt19937 rng;
   size_t num_points;
-  std::vector<PointMass> points;
+  // Its colors never change once built, so rendering reads them while the
+  // simulation runs.
+  Particles<2> particles;
 };
 
-struct VertexBuffer {
-  spk::buffer buffer;
-  spk::device_memory device_memory;
-  uint64_t size;
-  void* data;
-
-  void map() { device_memory.map_memory(0, size, data); }
-  void unmap() { device_memory.unmap_memory(); }
-  void update(const World& world) {
-    Vertex* v = (Vertex*)data;
-    for (size_t i = 0; i < world.num_points; ++i) {
-      v[i].color = world.points[i].color;
-      v[i].pos = world.points[i].pos;
-    }
-  }
+// The points' positions before and after one simulation step.
+struct Snapshot {
+  Positions<2> previous, current;
 };
 
-VertexBuffer create_vertex_buffer(spk::physical_device& physical_device,
-                                  spk::device& device) {
-  spk::buffer buffer = create_buffer(device);
-  const spk::memory_requirements memory_requirements =
-      buffer.memory_requirements();
-  spk::device_memory device_memory =
-      create_memory(physical_device, device, buffer);
-  buffer.bind_memory(device_memory, 0);
-
-  return {std::move(buffer), std::move(device_memory),
-          memory_requirements.size()};
-}
-
 spk::pipeline create_pipeline(spk::device& device, spkx::presenter& presenter) {
   spkx::pipeline_config config;
   config.vertex_shader = "test/pointtest.vert.spv";
   config.fragment_shader = "test/pointtest.frag.spv";
-  config.vertex_binding_descriptions.push_back(
-      get_vertex_input_binding_description());
-  config.vertex_attribute_descriptions =
-      get_vertex_input_attribute_descriptions();
+  if (compute) {
+    config.vertex_binding_descriptions.push_back(
+        get_vertex_input_binding_description(sizeof(GpuPoint)));
+    config.vertex_attribute_descriptions =
+        get_vertex_input_attribute_descriptions(offsetof(GpuPoint, pos),
+                                                offsetof(GpuPoint, color));
+  } else {
+    config.vertex_binding_descriptions.push_back(
+        get_vertex_input_binding_description(sizeof(Vertex)));
+    config.vertex_attribute_descriptions =
+        get_vertex_input_attribute_descriptions(offsetof(Vertex, pos),
+                                                offsetof(Vertex, color));
+  }
   config.topology = spk::primitive_topology::point_list;
 
   return spkx::create_pipeline(device, presenter, config);
@@ -238,37 +223,446 @@ spk::pipeline create_pipeline(spk::device& device, spkx::presenter& presenter) {
 //  return {std::move(command_pool), std::move(command_buffers)};
 //}
 
-std::vector<VertexBuffer> create_vertex_buffers(
-    size_t num_renderings, spk::physical_device& physical_device,
+spk::shader_module create_shader(spk::device& device,
+                                 const std::filesystem::path& path) {
+  DVC_ASSERT(exists(path), "file not found: ", path);
+  std::string code = dvc::load_file(path);
+  spk::shader_module_create_info create_info;
+  create_info.set_code_size(code.size());
+  create_info.set_p_code((uint32_t*)code.data());
+  return device.create_shader_module(create_info);
+}
+
+struct HostBuffer {
+  spk::buffer buffer;
+  spk::device_memory device_memory;
+  uint64_t size;
+  void* data;
+
+  void map() { device_memory.map_memory(0, size, data); }
+  void unmap() { device_memory.unmap_memory(); }
+};
+
+HostBuffer create_host_buffer(spk::physical_device& physical_device,
+                              spk::device& device, uint64_t size,
+                              spk::buffer_usage_flags usage) {
+  spk::buffer buffer = spkx::create_buffer(device, size, usage);
+  const spk::memory_requirements memory_requirements =
+      buffer.memory_requirements();
+  spk::device_memory device_memory = spkx::create_memory(
+      device, memory_requirements.size(),
+      spkx::find_compatible_memory_type(
+          physical_device, memory_requirements.memory_type_bits(),
+          spk::memory_property_flags::host_visible |
+              spk::memory_property_flags::host_coherent));
+  buffer.bind_memory(device_memory, 0);
+
+  return {std::move(buffer), std::move(device_memory),
+          memory_requirements.size()};
+}
+
+// local_size_x of test/pointtest.comp.
+constexpr uint32_t compute_group_size = 64;
+
+// The points resident on the device for --compute: their storage buffer,
+// which is also the vertex buffer, and the compute pipeline that steps
+// them, reading its parameters from each frame's uniforms.
+struct ComputeWorld {
+  spk::buffer points;
+  spk::device_memory points_memory;
+  spk::descriptor_set_layout descriptor_set_layout;
+  spk::pipeline_layout pipeline_layout;
+  spk::shader_module shader;
+  spk::pipeline pipeline;
+  spk::descriptor_pool descriptor_pool;
+  // Binds the parameters at their offset in the frame's uniforms.
+  spk::descriptor_set descriptor_set;
+
+  // Records steps dispatches of the compute shader, each after the reads
+  // and writes of the points before it, and makes the last visible to the
+  // vertex input of the draw that follows.  The parameters are allocated
+  // from frame_ring, begun for the rendering being recorded.
+  void record_steps(spk::command_buffer& command_buffer, FrameRing& frame_ring,
+                    const ComputeParams& step_params, uint64_t steps) {
+    const FrameRing::Allocation params =
+        frame_ring.allocate(sizeof(step_params));
+    std::memcpy(params.data, &step_params, sizeof(step_params));
+    const uint32_t params_offset = params.offset;
+
+    spk::descriptor_set_ref descriptor_set_ref = descriptor_set;
+    command_buffer.bind_pipeline(spk::pipeline_bind_point::compute, pipeline);
+    command_buffer.bind_descriptor_sets(spk::pipeline_bind_point::compute,
+                                        pipeline_layout, 0,
+                                        {&descriptor_set_ref, 1},
+                                        {&params_offset, 1});
+    for (uint64_t i = 0; i < steps; i++) {
+      spk::memory_barrier barrier;
+      barrier.set_src_access_mask(spk::access_flags::vertex_attribute_read |
+                                  spk::access_flags::shader_write);
+      barrier.set_dst_access_mask(spk::access_flags::shader_read |
+                                  spk::access_flags::shader_write);
+      command_buffer.pipeline_barrier(
+          spk::pipeline_stage_flags::vertex_input |
+              spk::pipeline_stage_flags::compute_shader,
+          spk::pipeline_stage_flags::compute_shader, {}, {&barrier, 1}, {},
+          {});
+      command_buffer.dispatch(
+          (step_params.num_points + compute_group_size - 1) /
+              compute_group_size,
+          1, 1);
+    }
+
+    spk::memory_barrier barrier;
+    barrier.set_src_access_mask(spk::access_flags::shader_write);
+    barrier.set_dst_access_mask(spk::access_flags::vertex_attribute_read);
+    command_buffer.pipeline_barrier(spk::pipeline_stage_flags::compute_shader,
+                                    spk::pipeline_stage_flags::vertex_input,
+                                    {}, {&barrier, 1}, {}, {});
+  }
+};
+
+// Records commands with record into a one-off command buffer, submits it to
+// queue and waits for it to finish.
+void run_once(spk::device& device, spk::queue& queue,
+              uint32_t queue_family_index,
+              const std::function<void(spk::command_buffer&)>& record) {
+  spk::command_pool_create_info create_info;
+  create_info.set_flags(spk::command_pool_create_flags::transient);
+  create_info.set_queue_family_index(queue_family_index);
+  spk::command_pool command_pool = device.create_command_pool(create_info);
+
+  spk::command_buffer_allocate_info command_buffer_allocate_info;
+  command_buffer_allocate_info.set_command_pool(command_pool);
+  command_buffer_allocate_info.set_level(spk::command_buffer_level::primary);
+  command_buffer_allocate_info.set_command_buffer_count(1);
+  spk::command_buffer command_buffer = std::move(
+      device.allocate_command_buffers(command_buffer_allocate_info).at(0));
+
+  spk::command_buffer_begin_info begin_info;
+  begin_info.set_flags(spk::command_buffer_usage_flags::one_time_submit);
+  command_buffer.begin(begin_info);
+  record(command_buffer);
+  command_buffer.end();
+
+  spk::submit_info submit_info;
+  spk::command_buffer_ref ref = command_buffer;
+  submit_info.set_command_buffers({&ref, 1});
+  queue.submit({&submit_info, 1}, VK_NULL_HANDLE);
+  queue.wait_idle();
+  command_pool.free_command_buffers({&ref, 1});
+}
+
+// Copies world's points into a device local storage buffer through a
+// staging buffer, once at startup.
+void upload_points(spk::physical_device& physical_device, spk::device& device,
+                   spk::queue& queue, uint32_t queue_family_index,
+                   const World& world, spk::buffer& points) {
+  const uint64_t size = sizeof(GpuPoint) * world.num_points;
+  HostBuffer staging = create_host_buffer(
+      physical_device, device, size, spk::buffer_usage_flags::transfer_src);
+  staging.map();
+  GpuPoint* gpu_points = (GpuPoint*)staging.data;
+  const Particles<2>& particles = world.particles;
+  for (size_t i = 0; i < world.num_points; ++i) {
+    gpu_points[i].pos = {particles.pos[0][i], particles.pos[1][i]};
+    gpu_points[i].velocity = {particles.vel[0][i], particles.vel[1][i]};
+    gpu_points[i].color = {particles.colors[3 * i], particles.colors[3 * i + 1],
+                           particles.colors[3 * i + 2], 1};
+  }
+  staging.unmap();
+
+  run_once(device, queue, queue_family_index,
+           [&](spk::command_buffer& command_buffer) {
+             spk::buffer_copy region;
+             region.set_size(size);
+             command_buffer.copy_buffer(staging.buffer, points, {&region, 1});
+
+             spk::memory_barrier barrier;
+             barrier.set_src_access_mask(spk::access_flags::transfer_write);
+             barrier.set_dst_access_mask(
+                 spk::access_flags::shader_read |
+                 spk::access_flags::shader_write |
+                 spk::access_flags::vertex_attribute_read);
+             command_buffer.pipeline_barrier(
+                 spk::pipeline_stage_flags::transfer,
+                 spk::pipeline_stage_flags::compute_shader |
+                     spk::pipeline_stage_flags::vertex_input,
+                 {}, {&barrier, 1}, {}, {});
+           });
+  device.free_memory(staging.device_memory);
+}
+
+spk::descriptor_set_layout create_compute_descriptor_set_layout(
     spk::device& device) {
-  std::vector<VertexBuffer> buffers;
-  for (size_t i = 0; i < num_renderings; ++i)
-    buffers.emplace_back(create_vertex_buffer(physical_device, device));
-  for (VertexBuffer& buffer : buffers) buffer.map();
-  return buffers;
+  spk::descriptor_set_layout_binding binding[2];
+  binding[0].set_binding(0);
+  binding[0].set_descriptor_type(spk::descriptor_type::storage_buffer);
+  binding[0].set_immutable_samplers({nullptr, 1});
+  binding[0].set_stage_flags(spk::shader_stage_flags::compute);
+
+  binding[1].set_binding(1);
+  binding[1].set_descriptor_type(spk::descriptor_type::uniform_buffer_dynamic);
+  binding[1].set_immutable_samplers({nullptr, 1});
+  binding[1].set_stage_flags(spk::shader_stage_flags::compute);
+
+  spk::descriptor_set_layout_create_info create_info;
+  create_info.set_bindings({binding, 2});
+  return device.create_descriptor_set_layout(create_info);
+}
+
+spk::pipeline_layout create_compute_pipeline_layout(
+    spk::device& device, spk::descriptor_set_layout& descriptor_set_layout) {
+  spk::pipeline_layout_create_info create_info;
+  spk::descriptor_set_layout_ref descriptor_set_layout_ref =
+      descriptor_set_layout;
+  create_info.set_set_layouts({&descriptor_set_layout_ref, 1});
+  return device.create_pipeline_layout(create_info);
+}
+
+spk::pipeline create_compute_pipeline(spk::device& device,
+                                      spk::shader_module& shader,
+                                      spk::pipeline_layout& pipeline_layout) {
+  spk::pipeline_shader_stage_create_info stage;
+  stage.set_module(shader);
+  stage.set_name("main");
+  stage.set_stage(spk::shader_stage_flags::compute);
+
+  spk::compute_pipeline_create_info create_info;
+  create_info.set_stage(stage);
+  create_info.set_layout(pipeline_layout);
+  return std::move(
+      device.create_compute_pipelines(VK_NULL_HANDLE, {&create_info, 1})
+          .at(0));
+}
+
+spk::descriptor_pool create_compute_descriptor_pool(spk::device& device) {
+  spk::descriptor_pool_create_info create_info;
+  create_info.set_max_sets(1);
+  spk::descriptor_pool_size size[2];
+  size[0].set_descriptor_count(1);
+  size[0].set_type(spk::descriptor_type::storage_buffer);
+  size[1].set_descriptor_count(1);
+  size[1].set_type(spk::descriptor_type::uniform_buffer_dynamic);
+  create_info.set_pool_sizes({size, 2});
+  return device.create_descriptor_pool(create_info);
+}
+
+ComputeWorld create_compute_world(spk::physical_device& physical_device,
+                                  spk::device& device, spk::queue& queue,
+                                  uint32_t queue_family_index,
+                                  FrameRing& frame_ring, const World& world) {
+  const uint64_t size = sizeof(GpuPoint) * world.num_points;
+  spk::buffer points = spkx::create_buffer(
+      device, size,
+      spk::buffer_usage_flags::storage_buffer |
+          spk::buffer_usage_flags::vertex_buffer |
+          spk::buffer_usage_flags::transfer_src |
+          spk::buffer_usage_flags::transfer_dst);
+  const spk::memory_requirements memory_requirements =
+      points.memory_requirements();
+  spk::device_memory points_memory = spkx::create_memory(
+      device, memory_requirements.size(),
+      spkx::find_compatible_memory_type(
+          physical_device, memory_requirements.memory_type_bits(),
+          spk::memory_property_flags::device_local));
+  points.bind_memory(points_memory, 0);
+  upload_points(physical_device, device, queue, queue_family_index, world,
+                points);
+
+  spk::descriptor_set_layout descriptor_set_layout =
+      create_compute_descriptor_set_layout(device);
+  spk::pipeline_layout pipeline_layout =
+      create_compute_pipeline_layout(device, descriptor_set_layout);
+  spk::shader_module shader = create_shader(device, "test/pointtest.comp.spv");
+  spk::pipeline pipeline =
+      create_compute_pipeline(device, shader, pipeline_layout);
+  spk::descriptor_pool descriptor_pool = create_compute_descriptor_pool(device);
+
+  spk::descriptor_set_allocate_info allocate_info;
+  allocate_info.set_descriptor_pool(descriptor_pool);
+  spk::descriptor_set_layout_ref layout = descriptor_set_layout;
+  allocate_info.set_set_layouts({&layout, 1});
+  spk::descriptor_set descriptor_set =
+      std::move(device.allocate_descriptor_sets(allocate_info).at(0));
+
+  spk::descriptor_buffer_info points_info;
+  points_info.set_buffer(points);
+  points_info.set_offset(0);
+  points_info.set_range(size);
+
+  spk::descriptor_buffer_info params_info;
+  params_info.set_buffer(frame_ring.buffer);
+  params_info.set_offset(0);
+  params_info.set_range(sizeof(ComputeParams));
+
+  spk::write_descriptor_set write[2];
+  write[0].set_dst_set(descriptor_set);
+  write[0].set_dst_binding(0);
+  write[0].set_dst_array_element(0);
+  write[0].set_descriptor_type(spk::descriptor_type::storage_buffer);
+  write[0].set_buffer_info({&points_info, 1});
+  write[0].set_image_info({nullptr, 1});
+  write[0].set_texel_buffer_view({nullptr, 1});
+
+  write[1].set_dst_set(descriptor_set);
+  write[1].set_dst_binding(1);
+  write[1].set_dst_array_element(0);
+  write[1].set_descriptor_type(spk::descriptor_type::uniform_buffer_dynamic);
+  write[1].set_buffer_info({&params_info, 1});
+  write[1].set_image_info({nullptr, 1});
+  write[1].set_texel_buffer_view({nullptr, 1});
+
+  device.update_descriptor_sets({write, 2}, {nullptr, 0});
+
+  return {std::move(points),
+          std::move(points_memory),
+          std::move(descriptor_set_layout),
+          std::move(pipeline_layout),
+          std::move(shader),
+          std::move(pipeline),
+          std::move(descriptor_pool),
+          std::move(descriptor_set)};
+}
+
+// For --check_compute: steps the points once on the device and reads them
+// back, through the same barriers as a frame, and fails unless they match
+// one Particles::step of world's.  Runs before any frame, while the points
+// on the device are still world's.
+void check_compute_step(spk::physical_device& physical_device,
+                        spk::device& device, spk::queue& queue,
+                        uint32_t queue_family_index, FrameRing& frame_ring,
+                        ComputeWorld& compute_world, const World& world) {
+  const glm::vec2 target{0.25, -0.5};
+  ComputeParams params;
+  params.mouse_pos = target;
+  params.alpha = step_alpha;
+  params.beta = step_beta;
+  params.gamma = step_gamma;
+  params.num_points = world.num_points;
+
+  const uint64_t size = sizeof(GpuPoint) * world.num_points;
+  HostBuffer readback = create_host_buffer(
+      physical_device, device, size, spk::buffer_usage_flags::transfer_dst);
+  readback.map();
+  frame_ring.begin(0);
+  run_once(device, queue, queue_family_index,
+           [&](spk::command_buffer& command_buffer) {
+             compute_world.record_steps(command_buffer, frame_ring, params, 1);
+
+             spk::memory_barrier barrier;
+             barrier.set_src_access_mask(spk::access_flags::shader_write);
+             barrier.set_dst_access_mask(spk::access_flags::transfer_read);
+             command_buffer.pipeline_barrier(
+                 spk::pipeline_stage_flags::compute_shader,
+                 spk::pipeline_stage_flags::transfer, {}, {&barrier, 1}, {},
+                 {});
+
+             spk::buffer_copy region;
+             region.set_size(size);
+             command_buffer.copy_buffer(compute_world.points, readback.buffer,
+                                        {&region, 1});
+           });
+
+  Particles<2> expected = world.particles;
+  expected.step(step_alpha, step_beta, step_gamma, {target.x, target.y});
+  const GpuPoint* gpu_points = (const GpuPoint*)readback.data;
+  float worst = 0;
+  for (size_t i = 0; i < world.num_points; i++) {
+    for (size_t axis = 0; axis < 2; axis++) {
+      worst = std::max(worst, std::abs(gpu_points[i].pos[axis] -
+                                       expected.pos[axis][i]));
+      worst = std::max(worst, std::abs(gpu_points[i].velocity[axis] -
+                                       expected.vel[axis][i]));
+    }
+  }
+  readback.unmap();
+  device.free_memory(readback.device_memory);
+
+  if (worst > 1e-5) DVC_FAIL("compute step differs by up to ", worst);
+  DVC_LOG("compute step matches Particles::step to within ", worst);
 }
 
 struct PointTest : spkx::game {
+  using Clock = std::chrono::steady_clock;
+
   World world;
+  // Without --compute.  Declared after world, so that it stops before world
+  // is destroyed.
+  std::unique_ptr<Simulation<Snapshot>> simulation;
   spk::pipeline pipeline;
-  std::vector<VertexBuffer> buffers;
+  // Each frame's vertices, or with --compute its parameters.
+  FrameRing frame_ring;
+  // With --compute, the points on the device and the steps dispatched since
+  // compute_start.
+  std::optional<ComputeWorld> compute_world;
+  Clock::time_point compute_start;
+  uint64_t compute_steps = 0;
+  uint64_t frames_rendered = 0;
 
   PointTest(int argc, char** argv)
       : spkx::game(argc, argv),
         world(::num_points),
         pipeline(create_pipeline(device(), presenter())),
-        buffers(create_vertex_buffers(num_renderings(), physical_device(),
-                                      device())) {}
+        frame_ring(create_frame_ring(
+            physical_device(), device(), num_renderings(),
+            {compute ? sizeof(ComputeParams) : sizeof(Vertex) * ::num_points},
+            spk::buffer_usage_flags::vertex_buffer |
+                spk::buffer_usage_flags::uniform_buffer)) {
+    if (check_compute && !compute) DVC_FAIL("--check_compute needs --compute");
+    if (compute) {
+      compute_world = create_compute_world(
+          physical_device(), device(), graphics_queue(),
+          graphics_queue_family(), frame_ring, world);
+      if (check_compute)
+        check_compute_step(physical_device(), device(), graphics_queue(),
+                           graphics_queue_family(), frame_ring, *compute_world,
+                           world);
+      compute_start = Clock::now();
+    } else {
+      simulation = std::make_unique<Simulation<Snapshot>>(
+          sim_rate, [this](Snapshot& snapshot) {
+            world.update(step_alpha, step_beta, step_gamma, snapshot.previous,
+                         snapshot.current);
+          });
+    }
+  }
 
   void tick() override {}
 
+  // Dispatches the steps due at --sim_rate since the last frame, up to a
+  // few, so that the simulation slows down rather than stalling the frame.
+  void step_on_device(spk::command_buffer& command_buffer) {
+    const uint64_t due =
+        std::chrono::duration<double>(Clock::now() - compute_start).count() *
+        sim_rate;
+    const uint64_t steps = std::min<uint64_t>(due - compute_steps, 4);
+    compute_steps = due;
+
+    ComputeParams params;
+    params.mouse_pos = world.mouse_pos();
+    params.alpha = step_alpha;
+    params.beta = step_beta;
+    params.gamma = step_gamma;
+    params.num_points = world.num_points;
+    compute_world->record_steps(command_buffer, frame_ring, params, steps);
+  }
+
   void prepare_rendering(
       spk::command_buffer& command_buffer, size_t rendering_index,
       spk::render_pass_begin_info& render_pass_begin_info) override {
-    VertexBuffer& current_buffer = buffers[rendering_index];
-
-    world.update(0.01, 0.1, 0.01);
-    current_buffer.update(world);
+    frame_ring.begin(rendering_index);
+    uint64_t offset = 0;
+    if (compute_world) {
+      step_on_device(command_buffer);
+    } else {
+      const FrameRing::Allocation vertices =
+          frame_ring.allocate(sizeof(Vertex) * ::num_points);
+      float alpha;
+      const Snapshot& snapshot = simulation->latest(alpha);
+      write_vertices(snapshot.previous, snapshot.current,
+                     world.particles.colors, alpha, (float*)vertices.data);
+      offset = vertices.offset;
+    }
 
     spk::clear_color_value clear_color_value;
     clear_color_value.set_float_32({0, 0, 0, 1});
@@ -281,11 +675,14 @@ struct PointTest : spkx::game {
                                      spk::subpass_contents::inline_);
 
     command_buffer.bind_pipeline(spk::pipeline_bind_point::graphics, pipeline);
-    spk::buffer_ref buffer_ref = current_buffer.buffer;
-    uint64_t offset = 0;
+    spk::buffer_ref buffer_ref = compute_world
+                                     ? spk::buffer_ref(compute_world->points)
+                                     : spk::buffer_ref(frame_ring.buffer);
     command_buffer.bind_vertex_buffers(0, 1, &buffer_ref, &offset);
     command_buffer.draw(::num_points, 1, 0, 0);
     command_buffer.end_render_pass();
+
+    if (++frames_rendered == frames) shutdown();
   }
 
   void mouse_motion(const mouse_motion_event& event) override {
@@ -296,10 +693,9 @@ struct PointTest : spkx::game {
   };
 
   ~PointTest() {
-    for (VertexBuffer& buffer : buffers) {
-      buffer.unmap();
-      device().free_memory(buffer.device_memory);
-    }
+    frame_ring.unmap();
+    device().free_memory(frame_ring.device_memory);
+    if (compute_world) device().free_memory(compute_world->points_memory);
   }
 };
 
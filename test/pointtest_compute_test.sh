@@ -0,0 +1,9 @@
+#!/bin/bash
+# Runs pointtest's compute path for a few frames after checking one step of
+# the compute shader against Particles::step.  Needs a display and a Vulkan
+# device; without a GPU, lavapipe under xvfb-run will do, e.g.
+#   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json \
+#     xvfb-run bazel test --test_env=VK_ICD_FILENAMES --test_env=DISPLAY \
+#     //test:pointtest_compute_test
+set -euo pipefail
+exec test/pointtest --compute --check_compute --frames=10 --num_points=10000
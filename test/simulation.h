@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+#include "dvc/log.h"
+
+// Passes the latest of a series of values from one writer thread to one
+// reader thread without locks and without either waiting for the other.
+// The writer fills back() and publishes it; the reader takes the most
+// recently published value, skipping any it was too slow to see.  Of the
+// three slots, the writer owns one, the reader another, and the third is
+// exchanged between them.
+template <typename T>
+class TripleBuffer {
+ public:
+  // Called by the writer: the slot to fill before publish().
+  T& back() { return slots[back_index]; }
+
+  // Called by the writer: hands back() to the reader and takes a new one.
+  void publish() {
+    back_index = spare.exchange(back_index | fresh, std::memory_order_acq_rel) &
+                 index_mask;
+  }
+
+  // Called by the reader: the latest published value, which stays valid
+  // until the reader's next call.  Default constructed before any.
+  const T& latest() {
+    if (spare.load(std::memory_order_relaxed) & fresh)
+      front_index =
+          spare.exchange(front_index, std::memory_order_acq_rel) & index_mask;
+    return slots[front_index];
+  }
+
+ private:
+  static constexpr unsigned index_mask = 3, fresh = 4;
+
+  std::array<T, 3> slots;
+  // Only touched by the writer and the reader respectively.
+  unsigned back_index = 0, front_index = 1;
+  // The exchanged slot's index, with fresh set if the writer has published
+  // it since the reader last took it.
+  alignas(64) std::atomic<unsigned> spare = 2;
+};
+
+// Steps a world at a fixed rate on its own thread, so that neither the
+// simulation's cost nor its rate depend on the frame rate.  step advances
+// the world by one step and writes what rendering needs into a Snapshot,
+// which the renderer reads with latest() and interpolates.
+template <typename Snapshot>
+class Simulation {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Runs one step before returning, so that latest() always has a
+  // snapshot.
+  Simulation(double steps_per_second, std::function<void(Snapshot&)> step)
+      : period(std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(1 / steps_per_second))),
+        step(std::move(step)) {
+    DVC_ASSERT(steps_per_second > 0);
+    run_step(Clock::now());
+    thread = std::thread([this] { run(); });
+  }
+
+  ~Simulation() {
+    stopping = true;
+    thread.join();
+  }
+
+  // Called by the renderer: the latest snapshot, and in alpha how far now
+  // is past it in steps, clamped to [0, 1].  Rendering a step behind the
+  // simulation, a snapshot holding the state before and after its step is
+  // interpolated by alpha.
+  const Snapshot& latest(float& alpha) {
+    const Stamped& stamped = buffer.latest();
+    alpha = std::clamp(
+        std::chrono::duration<float>(Clock::now() - stamped.time) / period,
+        0.0f, 1.0f);
+    return stamped.snapshot;
+  }
+
+ private:
+  struct Stamped {
+    // When the step was due.
+    Clock::time_point time;
+    Snapshot snapshot;
+  };
+
+  // Most steps run back to back to catch up; beyond that the simulation
+  // slows down rather than falling ever further behind.
+  static constexpr int max_catch_up = 4;
+
+  void run_step(Clock::time_point time) {
+    Stamped& stamped = buffer.back();
+    step(stamped.snapshot);
+    stamped.time = time;
+    buffer.publish();
+  }
+
+  void run() {
+    Clock::time_point next = Clock::now() + period;
+    while (!stopping) {
+      std::this_thread::sleep_until(next);
+      run_step(next);
+      next += period;
+      next = std::max(next, Clock::now() - max_catch_up * period);
+    }
+  }
+
+  const Clock::duration period;
+  const std::function<void(Snapshot&)> step;
+  TripleBuffer<Stamped> buffer;
+  std::atomic<bool> stopping = false;
+  std::thread thread;
+};
@@ -0,0 +1,49 @@
+#include "test/simulation.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "dvc/program.h"
+
+int main() {
+  dvc::program program;
+
+  // Values are seen in order, never torn, and the last one is seen.
+  TripleBuffer<std::vector<int>> buffer;
+  DVC_ASSERT(buffer.latest().empty());
+  constexpr int num_values = 100000;
+  std::thread writer([&] {
+    for (int i = 1; i <= num_values; i++) {
+      buffer.back().assign(16, i);
+      buffer.publish();
+    }
+  });
+  int last = 0;
+  while (last < num_values) {
+    const std::vector<int>& value = buffer.latest();
+    if (value.empty()) continue;
+    for (int v : value) DVC_ASSERT_EQ(v, value[0]);
+    DVC_ASSERT_GE(value[0], last);
+    last = value[0];
+  }
+  writer.join();
+
+  // Steps run at their own rate, whether or not anything reads them.
+  int steps = 0;
+  {
+    Simulation<int> simulation(1000, [&](int& snapshot) {
+      snapshot = ++steps;
+    });
+    // The first step runs before the constructor returns; later ones may
+    // already have too.
+    float alpha;
+    DVC_ASSERT_GE(simulation.latest(alpha), 1);
+    DVC_ASSERT(alpha >= 0 && alpha <= 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    const int seen = simulation.latest(alpha);
+    DVC_ASSERT_GT(seen, 20);
+    DVC_ASSERT(alpha >= 0 && alpha <= 1);
+  }
+  DVC_ASSERT_LT(steps, 200);
+}
@@ -4,12 +4,13 @@
 #include <SDL2/SDL_vulkan.h>
 #include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <functional>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/rotate_vector.hpp>
-#include <png++/png.hpp>
+#include <mutex>
 #include <random>
 #include <set>
 
@@ -18,16 +19,21 @@
 #include "dvc/log.h"
 #include "dvc/opts.h"
 #include "dvc/terminate.h"
+#include "gen/ktx2.h"
 #include "spk/game.h"
 #include "spk/helpers.h"
 #include "spk/loader.h"
 #include "spk/memory.h"
 #include "spk/spock.h"
+#include "test/frame_ring.h"
+#include "test/particles.h"
+#include "test/simulation.h"
 
 namespace {
 
 bool DVC_OPTION(trace_allocations, -, false, "trace vulkan allocations");
 uint64_t DVC_OPTION(num_points, -, 100, "num of points");
+double DVC_OPTION(sim_rate, -, 60, "simulation steps per second");
 
 struct Pipeline {
   //  spk::shader_module vertex_shader, fragment_shader;
@@ -42,22 +48,19 @@ struct UniformBufferObject {
 };
 
 spk::descriptor_set_layout create_descriptor_set_layout(spk::device& device) {
-  spk::descriptor_set_layout_binding binding[7];
+  spk::descriptor_set_layout_binding binding[2];
   binding[0].set_binding(0);
-  binding[0].set_descriptor_type(spk::descriptor_type::uniform_buffer);
+  binding[0].set_descriptor_type(spk::descriptor_type::uniform_buffer_dynamic);
   binding[0].set_immutable_samplers({nullptr, 1});
   binding[0].set_stage_flags(spk::shader_stage_flags::vertex);
 
-  for (int face = 0; face < 6; face++) {
-    binding[face + 1].set_binding(face + 1);
-    binding[face + 1].set_descriptor_type(
-        spk::descriptor_type::combined_image_sampler);
-    binding[face + 1].set_immutable_samplers({nullptr, 1});
-    binding[face + 1].set_stage_flags(spk::shader_stage_flags::fragment);
-  }
+  binding[1].set_binding(1);
+  binding[1].set_descriptor_type(spk::descriptor_type::combined_image_sampler);
+  binding[1].set_immutable_samplers({nullptr, 1});
+  binding[1].set_stage_flags(spk::shader_stage_flags::fragment);
 
   spk::descriptor_set_layout_create_info create_info;
-  create_info.set_bindings({binding, 7});
+  create_info.set_bindings({binding, 2});
   return device.create_descriptor_set_layout(create_info);
 }
 
@@ -65,23 +68,8 @@ struct Vertex {
   glm::vec3 pos;
   glm::vec3 color;
 };
-
-struct PointMass {
-  glm::vec3 pos;
-  glm::vec3 color;
-  glm::vec3 velocity;
-  void update(float alpha) {
-    pos += alpha * velocity;
-
-    auto adjust = [](float& pos, float& vel) {
-      if (pos > 1 && vel > 0) vel = -vel;
-      if (pos < -1 && vel < 0) vel = -vel;
-    };
-    adjust(pos.x, velocity.x);
-    adjust(pos.y, velocity.y);
-    adjust(pos.z, velocity.z);
-  }
-};
+// As write_vertices writes them.
+static_assert(sizeof(Vertex) == 6 * sizeof(float));
 
 spk::vertex_input_binding_description get_vertex_input_binding_description() {
   spk::vertex_input_binding_description vertex_input_binding_description;
@@ -135,15 +123,15 @@ struct Object {
 struct World {
   Object player;
 
-  World(size_t num_points) : num_points(num_points), points(num_points) {
+  World(size_t num_points) : num_points(num_points), particles(num_points) {
     rng.seed(std::random_device()());
 
     for (size_t i = 0; i < num_points; ++i) {
-      points[i].pos = glm::vec3{normal(), normal(), normal()};
-      points[i].color = glm::vec3{normal(), normal(), normal()};
-      points[i].velocity = glm::vec3{normal(), normal(), normal()};
-      points[i].update(0);
+      for (size_t axis = 0; axis < 3; axis++) particles.pos[axis][i] = normal();
+      for (size_t c = 0; c < 3; c++) particles.colors[3 * i + c] = normal();
+      for (size_t axis = 0; axis < 3; axis++) particles.vel[axis][i] = normal();
     }
+    particles.step(0, 0, 0, {0, 0, 0});
 
     player.pos = {-20, -20, -20};
     player.fac = {20, 20, 20};
@@ -152,16 +140,27 @@ struct World {
     player.normalize();
   }
 
-  void update(float alpha) {
-    for (auto& point : points) point.update(alpha);
+  // Steps the points and the player, writing the points' positions from
+  // before and after the step to previous and current.
+  void update(float alpha, Positions<3>& previous, Positions<3>& current) {
+    particles.step(alpha, 0, 0, {0, 0, 0}, previous, current);
 
+    std::lock_guard lock(player_mu);
     player.vel += player.dir * player.fac * 0.001f;
     player.pos += player.vel;
   }
 
+  Object get_player() const {
+    std::lock_guard lock(player_mu);
+    return player;
+  }
+
   float normal() { return normal_(rng); }
 
+  // The controls are called from the event thread while the simulation
+  // runs.
   void move_head(glm::vec2 headrel) { /*static constexpr float k = 0.01; */
+    std::lock_guard lock(player_mu);
     player.fac = glm::rotate(player.fac, headrel.x * -0.001f, player.up);
     player.normalize();
     player.fac = glm::rotate(player.fac, headrel.y * 0.001f,
@@ -169,88 +168,36 @@ struct World {
     player.normalize();
   }
 
-  void go_forward() { player.dir += 1; }
-  void go_backward() { player.dir -= 0.2; }
+  void go_forward() { steer(1); }
+  void go_backward() { steer(-0.2); }
   void go_left() { DVC_LOG("go_left"); }
   void go_right() { DVC_LOG("go_right"); }
-  void stop_forward() { player.dir -= 1; }
-  void stop_backward() { player.dir += 0.2; }
+  void stop_forward() { steer(-1); }
+  void stop_backward() { steer(0.2); }
   void stop_left() { DVC_LOG("stop_left"); }
   void stop_right() { DVC_LOG("stop_right"); }
 
+  void steer(float ddir) {
+    std::lock_guard lock(player_mu);
+    player.dir += ddir;
+  }
+
+  // Guards player between the controls and the simulation.
+  mutable std::mutex player_mu;
   std::normal_distribution<float> normal_;
   std::mt19937 rng;
   size_t num_points;
-  std::vector<PointMass> points;
+  // Its colors never change once built, so rendering reads them while the
+  // simulation runs.
+  Particles<3> particles;
 };
 
-struct VertexBuffer {
-  spk::buffer buffer;
-  spk::device_memory device_memory;
-  uint64_t size;
-  void* data;
-
-  void map() { device_memory.map_memory(0, size, data); }
-  void unmap() { device_memory.unmap_memory(); }
-  void update(const World& world) {
-    Vertex* v = (Vertex*)data;
-    for (size_t i = 0; i < world.num_points; ++i) {
-      v[i].color = world.points[i].color;
-      v[i].pos = world.points[i].pos;
-    }
-  }
+// The points and player before and after one simulation step.
+struct Snapshot {
+  Positions<3> previous, current;
+  Object previous_player, player;
 };
 
-VertexBuffer create_vertex_buffer(spk::physical_device& physical_device,
-                                  spk::device& device) {
-  spk::buffer buffer =
-      spkx::create_buffer(device, sizeof(Vertex) * ::num_points,
-                          spk::buffer_usage_flags::vertex_buffer);
-  const spk::memory_requirements memory_requirements =
-      buffer.memory_requirements();
-  spk::device_memory device_memory = spkx::create_memory(
-      device, memory_requirements.size(),
-      spkx::find_compatible_memory_type(
-          physical_device, memory_requirements.memory_type_bits(),
-          spk::memory_property_flags::host_visible |
-              spk::memory_property_flags::host_coherent));
-
-  buffer.bind_memory(device_memory, 0);
-
-  return {std::move(buffer), std::move(device_memory),
-          memory_requirements.size()};
-}
-
-struct UniformBuffer {
-  spk::buffer buffer;
-  spk::device_memory device_memory;
-  uint64_t size;
-  void* data;
-
-  void map() { device_memory.map_memory(0, size, data); }
-  void unmap() { device_memory.unmap_memory(); }
-  void update(const UniformBufferObject& ubo) { std::memcpy(data, &ubo, size); }
-};
-
-UniformBuffer create_uniform_buffer(spk::physical_device& physical_device,
-                                    spk::device& device) {
-  spk::buffer buffer =
-      spkx::create_buffer(device, sizeof(UniformBufferObject),
-                          spk::buffer_usage_flags::uniform_buffer);
-  const spk::memory_requirements memory_requirements =
-      buffer.memory_requirements();
-  spkx::memory_type_index memory_type_index = spkx::find_compatible_memory_type(
-      physical_device, memory_requirements.memory_type_bits(),
-      spk::memory_property_flags::host_visible |
-          spk::memory_property_flags::host_coherent);
-  spk::device_memory device_memory = spkx::create_memory(
-      device, memory_requirements.size(), memory_type_index);
-  buffer.bind_memory(device_memory, 0);
-
-  return {std::move(buffer), std::move(device_memory),
-          memory_requirements.size()};
-}
-
 spk::pipeline_layout create_pipeline_layout(
     spk::device& device, spk::descriptor_set_layout& descriptor_set_layout) {
   spk::pipeline_layout_create_info create_info;
@@ -288,34 +235,14 @@ spk::pipeline create_point_pipeline(spk::device& device,
   return spkx::create_pipeline(device, presenter, config);
 }
 
-std::vector<VertexBuffer> create_vertex_buffers(
-    size_t num_renderings, spk::physical_device& physical_device,
-    spk::device& device) {
-  std::vector<VertexBuffer> buffers;
-  for (size_t i = 0; i < num_renderings; ++i)
-    buffers.emplace_back(create_vertex_buffer(physical_device, device));
-  for (VertexBuffer& buffer : buffers) buffer.map();
-  return buffers;
-}
-
-std::vector<UniformBuffer> create_uniform_buffers(
-    size_t num_renderings, spk::physical_device& physical_device,
-    spk::device& device) {
-  std::vector<UniformBuffer> buffers;
-  for (size_t i = 0; i < num_renderings; ++i)
-    buffers.emplace_back(create_uniform_buffer(physical_device, device));
-  for (UniformBuffer& buffer : buffers) buffer.map();
-  return buffers;
-}
-
 spk::descriptor_pool create_descriptor_pool(spk::device& device,
                                             uint32_t pool_size) {
   spk::descriptor_pool_create_info create_info;
   create_info.set_max_sets(pool_size);
   spk::descriptor_pool_size size[2];
   size[0].set_descriptor_count(pool_size);
-  size[0].set_type(spk::descriptor_type::uniform_buffer);
-  size[1].set_descriptor_count(pool_size * 6);
+  size[0].set_type(spk::descriptor_type::uniform_buffer_dynamic);
+  size[1].set_descriptor_count(pool_size);
   size[1].set_type(spk::descriptor_type::combined_image_sampler);
   create_info.set_pool_sizes({size, 2});
   return device.create_descriptor_pool(create_info);
@@ -339,17 +266,18 @@ struct ImageBuffer {
   spk::sampler sampler;
 };
 
-spk::image create_image(spk::device& device, uint32_t width, uint32_t height,
-                        spk::format format) {
+spk::image create_cube_image(spk::device& device, uint32_t width,
+                             uint32_t num_levels, spk::format format) {
   spk::image_create_info create_info;
+  create_info.set_flags(spk::image_create_flags::cube_compatible);
   create_info.set_image_type(spk::image_type::n2d);
   spk::extent_3d extent;
   extent.set_width(width);
-  extent.set_height(height);
+  extent.set_height(width);
   extent.set_depth(1);
   create_info.set_extent(extent);
-  create_info.set_mip_levels(1);
-  create_info.set_array_layers(1);
+  create_info.set_mip_levels(num_levels);
+  create_info.set_array_layers(6);
   create_info.set_format(format);
   create_info.set_tiling(spk::image_tiling::optimal);
   create_info.set_initial_layout(spk::image_layout::undefined);
@@ -365,7 +293,8 @@ void immediate_copy_image(spk::device& device, spk::queue& transfer_queue,
                           uint32_t transfer_queue_family_index,
                           uint32_t graphics_queue_family_index,
                           spk::buffer& host_buffer, spk::image& image,
-                          uint32_t width, uint32_t height) {
+                          uint32_t num_levels,
+                          const std::vector<spk::buffer_image_copy>& regions) {
   spk::command_pool_create_info create_info;
   create_info.set_flags(spk::command_pool_create_flags::transient);
   create_info.set_queue_family_index(transfer_queue_family_index);
@@ -394,8 +323,8 @@ void immediate_copy_image(spk::device& device, spk::queue& transfer_queue,
 
     spk::image_subresource_range range;
     range.set_aspect_mask(spk::image_aspect_flags::color);
-    range.set_level_count(1);
-    range.set_layer_count(1);
+    range.set_level_count(num_levels);
+    range.set_layer_count(6);
     barrier.set_subresource_range(range);
 
     command_buffer.pipeline_barrier(spk::pipeline_stage_flags::top_of_pipe,
@@ -403,22 +332,9 @@ void immediate_copy_image(spk::device& device, spk::queue& transfer_queue,
                                     {}, {&barrier, 1});
   }
 
-  spk::buffer_image_copy region;
-
-  spk::image_subresource_layers layers;
-  layers.set_aspect_mask(spk::image_aspect_flags::color);
-  layers.set_layer_count(1);
-  region.set_image_subresource(layers);
-
-  spk::extent_3d extent;
-  extent.set_width(width);
-  extent.set_height(height);
-  extent.set_depth(1);
-  region.set_image_extent(extent);
-
-  command_buffer.copy_buffer_to_image(host_buffer, image,
-                                      spk::image_layout::transfer_dst_optimal,
-                                      {&region, 1});
+  command_buffer.copy_buffer_to_image(
+      host_buffer, image, spk::image_layout::transfer_dst_optimal,
+      {regions.data(), uint32_t(regions.size())});
 
   {
     spk::image_memory_barrier barrier;
@@ -432,8 +348,8 @@ void immediate_copy_image(spk::device& device, spk::queue& transfer_queue,
 
     spk::image_subresource_range range;
     range.set_aspect_mask(spk::image_aspect_flags::color);
-    range.set_level_count(1);
-    range.set_layer_count(1);
+    range.set_level_count(num_levels);
+    range.set_layer_count(6);
     barrier.set_subresource_range(range);
 
     command_buffer.pipeline_barrier(spk::pipeline_stage_flags::transfer,
@@ -450,22 +366,23 @@ void immediate_copy_image(spk::device& device, spk::queue& transfer_queue,
   command_pool.free_command_buffers({&ref, 1});
 }
 
-spk::image_view create_image_view(spk::device& device, spk::image& image) {
+spk::image_view create_cube_image_view(spk::device& device, spk::image& image,
+                                       uint32_t num_levels) {
   spk::image_view_create_info info;
   info.set_image(image);
-  info.set_view_type(spk::image_view_type::n2d);
+  info.set_view_type(spk::image_view_type::cube);
   info.set_format(spk::format::r8g8b8a8_unorm);
 
   spk::image_subresource_range range;
   range.set_aspect_mask(spk::image_aspect_flags::color);
-  range.set_level_count(1);
-  range.set_layer_count(1);
+  range.set_level_count(num_levels);
+  range.set_layer_count(6);
   info.set_subresource_range(range);
 
   return device.create_image_view(info);
 }
 
-spk::sampler create_texture_sampler(spk::device& device) {
+spk::sampler create_texture_sampler(spk::device& device, uint32_t num_levels) {
   spk::sampler_create_info info;
   info.set_mag_filter(spk::filter::linear);
   info.set_min_filter(spk::filter::linear);
@@ -479,26 +396,42 @@ spk::sampler create_texture_sampler(spk::device& device) {
   info.set_compare_enable(true);
   info.set_compare_op(spk::compare_op::always);
   info.set_mipmap_mode(spk::sampler_mipmap_mode::linear);
+  info.set_max_lod(num_levels);
   return device.create_sampler(info);
 }
 
+// Uploads every face and mip level of a KTX2 cube map through one staging
+// buffer and one copy.
 ImageBuffer create_image_buffer(spk::physical_device& physical_device,
                                 spk::device& device, spk::queue& transfer_queue,
                                 spk::queue& graphics_queue,
                                 uint32_t transfer_queue_family_index,
-                                uint32_t graphics_queue_family_index,
-                                int face) {
-  png::image<png::rgba_pixel, png::solid_pixel_buffer<png::rgba_pixel>> image(
-      dvc::concat("test/face", face, ".png"));
-  DVC_DUMP(image.get_width());
-  DVC_DUMP(image.get_height());
-
-  const std::vector<png::byte>& bytes = image.get_pixbuf().get_bytes();
-
-  DVC_ASSERT_EQ(image.get_width() * image.get_height() * 4, bytes.size());
+                                uint32_t graphics_queue_family_index) {
+  const ktx2::CubeReader cube("test/stars.ktx2");
+  DVC_DUMP(cube.width());
+  DVC_DUMP(cube.num_levels());
+
+  std::vector<spk::buffer_image_copy> regions(cube.num_levels());
+  uint64_t size = 0;
+  for (uint32_t level = 0; level < cube.num_levels(); level++) {
+    spk::image_subresource_layers layers;
+    layers.set_aspect_mask(spk::image_aspect_flags::color);
+    layers.set_mip_level(level);
+    layers.set_layer_count(6);
+    regions[level].set_image_subresource(layers);
+    regions[level].set_buffer_offset(size);
+
+    spk::extent_3d extent;
+    extent.set_width(cube.level_width(level));
+    extent.set_height(cube.level_width(level));
+    extent.set_depth(1);
+    regions[level].set_image_extent(extent);
+
+    size += cube.level_size(level);
+  }
 
   spk::buffer buffer = spkx::create_buffer(
-      device, bytes.size(), spk::buffer_usage_flags::transfer_src);
+      device, size, spk::buffer_usage_flags::transfer_src);
 
   const spk::memory_requirements memory_requirements =
       buffer.memory_requirements();
@@ -511,13 +444,13 @@ ImageBuffer create_image_buffer(spk::physical_device& physical_device,
   buffer.bind_memory(device_memory, 0);
 
   void* buf;
-  device_memory.map_memory(0, bytes.size(), buf);
-  std::memcpy(buf, bytes.data(), bytes.size());
+  device_memory.map_memory(0, size, buf);
+  for (uint32_t level = 0; level < cube.num_levels(); level++)
+    cube.read_level(level, (char*)buf + regions[level].buffer_offset());
   device_memory.unmap_memory();
 
-  spk::image device_image =
-      create_image(device, image.get_width(), image.get_height(),
-                   spk::format::r8g8b8a8_unorm);
+  spk::image device_image = create_cube_image(
+      device, cube.width(), cube.num_levels(), spk::format::r8g8b8a8_unorm);
 
   const spk::memory_requirements image_memory_requirements =
       device_image.memory_requirements();
@@ -531,47 +464,44 @@ ImageBuffer create_image_buffer(spk::physical_device& physical_device,
 
   immediate_copy_image(device, transfer_queue, graphics_queue,
                        transfer_queue_family_index, graphics_queue_family_index,
-                       buffer, device_image, image.get_width(),
-                       image.get_height());
+                       buffer, device_image, cube.num_levels(), regions);
 
   device.free_memory(device_memory);
 
-  spk::image_view image_view = create_image_view(device, device_image);
+  spk::image_view image_view =
+      create_cube_image_view(device, device_image, cube.num_levels());
 
-  spk::sampler sampler = create_texture_sampler(device);
+  spk::sampler sampler = create_texture_sampler(device, cube.num_levels());
 
   return {memory_requirements.size(), std::move(device_image),
           std::move(image_device_memory), std::move(image_view),
           std::move(sampler)};
 }
 
-std::vector<ImageBuffer> create_image_buffers(
-    spk::physical_device& physical_device, spk::device& device,
-    spk::queue& transfer_queue, spk::queue& graphics_queue,
-    uint32_t transfer_queue_family_index,
-    uint32_t graphics_queue_family_index) {
-  std::vector<ImageBuffer> image_buffers;
-  for (int face = 0; face < 6; face++)
-    image_buffers.push_back(create_image_buffer(
-        physical_device, device, transfer_queue, graphics_queue,
-        transfer_queue_family_index, graphics_queue_family_index, face));
-  return std::move(image_buffers);
-}
-
 struct SkyFly : spkx::game {
   World world;
+  // Declared after world, so that it stops before world is destroyed.
+  Simulation<Snapshot> simulation;
   spk::descriptor_set_layout descriptor_set_layout;
   spk::pipeline_layout pipeline_layout;
   spk::pipeline point_pipeline, stars_pipeline;
-  std::vector<VertexBuffer> vertex_buffers;
-  std::vector<UniformBuffer> uniform_buffers;
-  std::vector<ImageBuffer> image_buffers;
+  // Each frame's vertices and uniforms.
+  FrameRing frame_ring;
+  ImageBuffer image_buffer;
   spk::descriptor_pool descriptor_pool;
-  std::vector<spk::descriptor_set> descriptor_sets;
+  // Shared by the renderings, which bind the uniforms at their offset in
+  // frame_ring.
+  spk::descriptor_set descriptor_set;
 
   SkyFly(int argc, char** argv)
       : spkx::game(argc, argv),
         world(::num_points),
+        simulation(sim_rate,
+                   [this](Snapshot& snapshot) {
+                     snapshot.previous_player = world.get_player();
+                     world.update(0.01, snapshot.previous, snapshot.current);
+                     snapshot.player = world.get_player();
+                   }),
         descriptor_set_layout(create_descriptor_set_layout(device())),
         pipeline_layout(
             create_pipeline_layout(device(), descriptor_set_layout)),
@@ -579,54 +509,45 @@ struct SkyFly : spkx::game {
             create_point_pipeline(device(), presenter(), pipeline_layout)),
         stars_pipeline(
             create_stars_pipeline(device(), presenter(), pipeline_layout)),
-        vertex_buffers(create_vertex_buffers(num_renderings(),
-                                             physical_device(), device())),
-        uniform_buffers(create_uniform_buffers(num_renderings(),
-                                               physical_device(), device())),
-        image_buffers(create_image_buffers(
+        frame_ring(create_frame_ring(
+            physical_device(), device(), num_renderings(),
+            {sizeof(Vertex) * ::num_points, sizeof(UniformBufferObject)},
+            spk::buffer_usage_flags::vertex_buffer |
+                spk::buffer_usage_flags::uniform_buffer)),
+        image_buffer(create_image_buffer(
             physical_device(), device(), transfer_queue(), graphics_queue(),
             transfer_queue_family(), graphics_queue_family())),
-        descriptor_pool(create_descriptor_pool(device(), num_renderings())),
-        descriptor_sets(create_descriptor_sets(device(), descriptor_pool,
-                                               descriptor_set_layout,
-                                               num_renderings())) {
-    DVC_ASSERT_EQ(uniform_buffers.size(), descriptor_sets.size());
-    DVC_ASSERT_EQ(uniform_buffers.size(), num_renderings());
-    for (size_t i = 0; i < num_renderings(); i++) {
-      spk::descriptor_buffer_info buffer_info;
-      buffer_info.set_buffer(uniform_buffers[i].buffer);
-      buffer_info.set_offset(0);
-      buffer_info.set_range(sizeof(UniformBufferObject));
-
-      spk::descriptor_image_info image_info[6];
-      for (int face = 0; face < 6; face++) {
-        image_info[face].set_image_layout(
-            spk::image_layout::shader_read_only_optimal);
-        image_info[face].set_image_view(image_buffers[face].image_view);
-        image_info[face].set_sampler(image_buffers[face].sampler);
-      }
-
-      spk::write_descriptor_set write[7];
-      write[0].set_buffer_info({&buffer_info, 1});
-      write[0].set_descriptor_type(spk::descriptor_type::uniform_buffer);
-      write[0].set_dst_array_element(0);
-      write[0].set_dst_binding(0);
-      write[0].set_dst_set(descriptor_sets[i]);
-      write[0].set_image_info({nullptr, 1});
-      write[0].set_texel_buffer_view({nullptr, 1});
-
-      for (int face = 0; face < 6; face++) {
-        write[face + 1].set_dst_set(descriptor_sets[i]);
-        write[face + 1].set_dst_binding(face + 1);
-        write[face + 1].set_dst_array_element(0);
-        write[face + 1].set_descriptor_type(
-            spk::descriptor_type::combined_image_sampler);
-
-        write[face + 1].set_image_info({image_info + face, 1});
-      }
-
-      device().update_descriptor_sets({write, 7}, {nullptr, 0});
-    }
+        descriptor_pool(create_descriptor_pool(device(), 1)),
+        descriptor_set(std::move(
+            create_descriptor_sets(device(), descriptor_pool,
+                                   descriptor_set_layout, 1)
+                .at(0))) {
+    spk::descriptor_buffer_info buffer_info;
+    buffer_info.set_buffer(frame_ring.buffer);
+    buffer_info.set_offset(0);
+    buffer_info.set_range(sizeof(UniformBufferObject));
+
+    spk::descriptor_image_info image_info;
+    image_info.set_image_layout(spk::image_layout::shader_read_only_optimal);
+    image_info.set_image_view(image_buffer.image_view);
+    image_info.set_sampler(image_buffer.sampler);
+
+    spk::write_descriptor_set write[2];
+    write[0].set_buffer_info({&buffer_info, 1});
+    write[0].set_descriptor_type(spk::descriptor_type::uniform_buffer_dynamic);
+    write[0].set_dst_array_element(0);
+    write[0].set_dst_binding(0);
+    write[0].set_dst_set(descriptor_set);
+    write[0].set_image_info({nullptr, 1});
+    write[0].set_texel_buffer_view({nullptr, 1});
+
+    write[1].set_dst_set(descriptor_set);
+    write[1].set_dst_binding(1);
+    write[1].set_dst_array_element(0);
+    write[1].set_descriptor_type(spk::descriptor_type::combined_image_sampler);
+    write[1].set_image_info({&image_info, 1});
+
+    device().update_descriptor_sets({write, 2}, {nullptr, 0});
   }
 
   void tick() override {}
@@ -635,20 +556,27 @@ struct SkyFly : spkx::game {
       spk::command_buffer& command_buffer, size_t rendering_index,
       spk::render_pass_begin_info& render_pass_begin_info) override {
     // std::terminate();
-    VertexBuffer& current_buffer = vertex_buffers[rendering_index];
-    UniformBuffer& uniform_buffer = uniform_buffers[rendering_index];
-
-    world.update(0.01);
-    current_buffer.update(world);
-
+    frame_ring.begin(rendering_index);
+    const FrameRing::Allocation vertices =
+        frame_ring.allocate(sizeof(Vertex) * ::num_points);
+    const FrameRing::Allocation uniforms =
+        frame_ring.allocate(sizeof(UniformBufferObject));
+
+    float alpha;
+    const Snapshot& snapshot = simulation.latest(alpha);
+    write_vertices(snapshot.previous, snapshot.current, world.particles.colors,
+                   alpha, (float*)vertices.data);
+
+    const Object& player = snapshot.player;
+    const glm::vec3 pos =
+        glm::mix(snapshot.previous_player.pos, player.pos, alpha);
     UniformBufferObject ubo;
-    glm::mat4 lookat = glm::lookAt(
-        world.player.pos, world.player.pos + world.player.fac, world.player.up);
+    glm::mat4 lookat = glm::lookAt(pos, pos + player.fac, player.up);
     glm::mat4 proj = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f);
     ubo.mvp = proj * lookat;
-    ubo.imvp = glm::translate(-world.player.pos) * glm::inverse(ubo.mvp);
+    ubo.imvp = glm::translate(-pos) * glm::inverse(ubo.mvp);
 
-    uniform_buffer.update(ubo);
+    std::memcpy(uniforms.data, &ubo, sizeof(ubo));
     spk::clear_color_value clear_color_value;
     clear_color_value.set_float_32({0, 0, 0, 1});
 
@@ -656,8 +584,8 @@ struct SkyFly : spkx::game {
     clear_color.set_color(clear_color_value);
     render_pass_begin_info.set_clear_values({&clear_color, 1});
 
-    spk::descriptor_set_ref descriptor_set_ref =
-        descriptor_sets.at(rendering_index);
+    spk::descriptor_set_ref descriptor_set_ref = descriptor_set;
+    const uint32_t uniforms_offset = uniforms.offset;
 
     command_buffer.begin_render_pass(render_pass_begin_info,
                                      spk::subpass_contents::inline_);
@@ -666,18 +594,20 @@ struct SkyFly : spkx::game {
                                  stars_pipeline);
     command_buffer.bind_descriptor_sets(spk::pipeline_bind_point::graphics,
                                         pipeline_layout, 0,
-                                        {&descriptor_set_ref, 1}, {nullptr, 0});
+                                        {&descriptor_set_ref, 1},
+                                        {&uniforms_offset, 1});
 
     command_buffer.draw(6, 1, 0, 0);
 
     command_buffer.bind_pipeline(spk::pipeline_bind_point::graphics,
                                  point_pipeline);
-    spk::buffer_ref buffer_ref = current_buffer.buffer;
-    uint64_t offset = 0;
+    spk::buffer_ref buffer_ref = frame_ring.buffer;
+    uint64_t offset = vertices.offset;
     command_buffer.bind_vertex_buffers(0, 1, &buffer_ref, &offset);
     command_buffer.bind_descriptor_sets(spk::pipeline_bind_point::graphics,
                                         pipeline_layout, 0,
-                                        {&descriptor_set_ref, 1}, {nullptr, 0});
+                                        {&descriptor_set_ref, 1},
+                                        {&uniforms_offset, 1});
     command_buffer.draw(::num_points, 1, 0, 0);
 
     command_buffer.end_render_pass();
@@ -726,16 +656,9 @@ struct SkyFly : spkx::game {
   }
 
   ~SkyFly() {
-    for (int face = 0; face < 6; face++)
-      device().free_memory(image_buffers[face].image_memory);
-    for (VertexBuffer& buffer : vertex_buffers) {
-      buffer.unmap();
-      device().free_memory(buffer.device_memory);
-    }
-    for (UniformBuffer& buffer : uniform_buffers) {
-      buffer.unmap();
-      device().free_memory(buffer.device_memory);
-    }
+    device().free_memory(image_buffer.image_memory);
+    frame_ring.unmap();
+    device().free_memory(frame_ring.device_memory);
   }
 };
 